@@ -0,0 +1,202 @@
+#include <pebble.h>
+#include <time.h>
+
+#include "libs/RecordSchema.h"
+#include "baseline/data-processor.h"
+
+// Decodes loan record sets of 10 KB to 1 MB and reports records per second
+// and heap allocations per record for:
+//
+//   data-processor    the baseline inbox parser: one counting pass, then a
+//                     malloc'd copy of every field
+//   text              RecordDecoder over '|'-delimited text
+//   binary            RecordDecoder over length-prefixed binary records
+//
+// Each run decodes a fresh copy of the payload, since decoding works in
+// place; copying is not timed. Allocations are counted by wrapping malloc,
+// calloc and realloc at link time (see the Makefile).
+
+#define LOAN_FIELDS(X)                \
+    X(LOAN_ID,         RF_U32)        \
+    X(LOAN_NAME,       RF_STR)        \
+    X(LOAN_USE,        RF_STR)        \
+    X(LOAN_CNTRY,      RF_CC)         \
+    X(LOAN_FUNDED_AMT, RF_U16)        \
+    X(LOAN_LOAN_AMT,   RF_U16)
+
+RECORD_SCHEMA_FIELDS(LOAN, LOAN_FIELDS)
+
+#define MIN_BENCH_NS  200000000ull
+
+
+// Allocation counting
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t qty, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static unsigned long allocQty = 0;
+
+void* __wrap_malloc(size_t size) { allocQty++; return __real_malloc(size); }
+void* __wrap_calloc(size_t qty, size_t size) { allocQty++; return __real_calloc(qty, size); }
+void* __wrap_realloc(void* ptr, size_t size) { allocQty++; return __real_realloc(ptr, size); }
+
+
+static uint64_t nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static const char* names[] = { "Ann", "Juan Carlos", "Women of Hope Group", "Li", "Amara" };
+static const char* uses[] = {
+  "to buy a cow",
+  "to purchase seeds and fertilizer for the coming season",
+  "to stock her shop with rice, sugar and cooking oil",
+};
+static const char* countries[] = { "KE", "PE", "PH", "US", "KH" };
+
+
+static size_t textRecord(char* out, uint32_t idx) {
+  return sprintf(out, "%s%u|%s|%s|%s|%u|%u", (idx == 0) ? "" : "|", 1000000 + idx, names[idx % 5], uses[idx % 3],
+                 countries[idx % 5], (idx * 25) % 1000, 1000);
+}
+
+static size_t binaryRecord(uint8_t* out, uint32_t idx) {
+  uint8_t* p = out + 2;
+  uint32_t id = 1000000 + idx;
+  uint16_t funded = (idx * 25) % 1000;
+  uint16_t amount = 1000;
+
+  for (int b = 0; b < 4; b++) { *p++ = (uint8_t)(id >> (8 * b)); }
+  for (int f = 0; f < 2; f++) {
+    const char* str = (f == 0) ? names[idx % 5] : uses[idx % 3];
+    *p++ = (uint8_t) strlen(str);
+    memcpy(p, str, strlen(str));
+    p += strlen(str);
+  }
+  memcpy(p, countries[idx % 5], 2);
+  p += 2;
+  *p++ = (uint8_t) funded;   *p++ = (uint8_t)(funded >> 8);
+  *p++ = (uint8_t) amount;   *p++ = (uint8_t)(amount >> 8);
+
+  size_t recLen = p - (out + 2);
+  out[0] = (uint8_t) recLen;
+  out[1] = (uint8_t)(recLen >> 8);
+  return p - out;
+}
+
+
+// Builds a payload of about targetLen bytes; returns its length.
+static size_t buildPayload(uint8_t* buf, size_t targetLen, bool binary, uint32_t* recordQty) {
+  uint8_t rec[256];
+  size_t len = 0;
+
+  for (*recordQty = 0; ; (*recordQty)++) {
+    size_t recLen = binary ? binaryRecord(rec, *recordQty) : textRecord((char*) rec, *recordQty);
+    if (len + recLen > targetLen) { break; }
+    memcpy(buf + len, rec, recLen);
+    len += recLen;
+  }
+  buf[len] = '\0';
+  return len;
+}
+
+
+static uint32_t checksum = 0;
+
+static MagPebApp_ErrCode emitLoan(void* context, const RecordValue* values) {
+  (void) context;
+  checksum += values[LOAN_ID].u32 + values[LOAN_NAME].str[0] + values[LOAN_LOAN_AMT].u16;
+  return MPA_SUCCESS;
+}
+
+static const RecordSchema loanSchema = {
+  .readable = "loan",
+  .numFields = LOAN_NUM_FIELDS,
+  .fields = LOAN_fieldTypes,
+  .emit = emitLoan,
+};
+
+
+static void decodeDataProcessor(char* buf, uint32_t recordQty) {
+  ProcessingState* state = data_processor_create(buf, '|');
+  checksum += data_processor_count(state);
+  for (uint32_t rec = 0; rec < recordQty; rec++) {
+    checksum += data_processor_get_int(state);
+    for (int f = 0; f < 3; f++) {
+      char* str = data_processor_get_string(state);
+      checksum += str[0];
+      free(str);
+    }
+    checksum += data_processor_get_int(state);
+    checksum += data_processor_get_int(state);
+  }
+  data_processor_destroy(state);
+}
+
+static void decodeRecords(uint8_t* buf, size_t len, bool binary) {
+  RecordDecoder decoder;
+  bool done = false;
+
+  if (binary) {
+    RecordDecoder_initBinary(&decoder, &loanSchema, buf, len, NULL);
+  } else {
+    RecordDecoder_init(&decoder, &loanSchema, (char*) buf, len, '|', NULL);
+  }
+  while (!done) {
+    if (RecordDecoder_step(&decoder, UINT16_MAX, &done) != MPA_SUCCESS) {
+      fprintf(stderr, "decoding failed after %u records\n", decoder.recordQty);
+      exit(1);
+    }
+  }
+}
+
+
+typedef enum Mode { MODE_DATA_PROCESSOR, MODE_TEXT, MODE_BINARY, MODE_QTY } Mode;
+static const char* modeNames[MODE_QTY] = { "data-processor", "text", "binary" };
+
+
+static void bench(Mode mode, size_t targetLen) {
+  bool binary = (mode == MODE_BINARY);
+  uint8_t* payload = malloc(targetLen + 1);
+  uint8_t* work = malloc(targetLen + 1);
+  uint32_t recordQty = 0;
+  size_t len = buildPayload(payload, targetLen, binary, &recordQty);
+
+  uint64_t elapsed = 0;
+  unsigned long allocs = 0;
+  unsigned long runs = 0;
+  while (elapsed < MIN_BENCH_NS) {
+    memcpy(work, payload, len + 1);
+    unsigned long allocsBefore = allocQty;
+    uint64_t start = nowNs();
+    if (mode == MODE_DATA_PROCESSOR) {
+      decodeDataProcessor((char*) work, recordQty);
+    } else {
+      decodeRecords(work, len, binary);
+    }
+    elapsed += nowNs() - start;
+    allocs += allocQty - allocsBefore;
+    runs++;
+  }
+
+  double records = (double) recordQty * runs;
+  printf("%-15s %8zu B %7u rec %12.0f rec/s %8.2f allocs/rec\n", modeNames[mode], len, recordQty,
+         records / (elapsed / 1e9), allocs / records);
+  free(work);
+  free(payload);
+}
+
+
+int main(void) {
+  static const size_t sizes[] = { 10 * 1024, 100 * 1024, 1024 * 1024 };
+
+  for (size_t s = 0; s < ARRAY_LENGTH(sizes); s++) {
+    for (Mode mode = 0; mode < MODE_QTY; mode++) {
+      bench(mode, sizes[s]);
+    }
+  }
+  printf("(checksum %u)\n", checksum);
+  return 0;
+}
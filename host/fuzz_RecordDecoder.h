@@ -0,0 +1,77 @@
+#pragma once
+
+#include <pebble.h>
+#include <assert.h>
+
+#include "libs/RecordSchema.h"
+
+// Shared body of the RecordDecoder fuzz targets. The first input byte sets
+// how many records each RecordDecoder_step() call may decode, so that
+// resuming is exercised too; the rest is the payload. The schema has one
+// field of every type.
+
+#define FUZZ_FIELDS(X)        \
+    X(FUZZ_U32, RF_U32)       \
+    X(FUZZ_U16, RF_U16)       \
+    X(FUZZ_STR, RF_STR)       \
+    X(FUZZ_CC,  RF_CC)        \
+    X(FUZZ_U8,  RF_U8)
+
+RECORD_SCHEMA_FIELDS(FUZZ, FUZZ_FIELDS)
+
+
+typedef struct FuzzPayload {
+  const char* start;
+  const char* end;
+} FuzzPayload;
+
+
+static MagPebApp_ErrCode fuzzEmit(void* context, const RecordValue* values) {
+  const FuzzPayload* payload = context;
+  const char* str = values[FUZZ_STR].str;
+
+  assert( (str >= payload->start) && (str + strlen(str) <= payload->end) );
+  assert( (strlen(values[FUZZ_CC].cc) == 2) );
+  return MPA_SUCCESS;
+}
+
+
+static const RecordSchema fuzzSchema = {
+  .readable = "fuzz",
+  .numFields = FUZZ_NUM_FIELDS,
+  .fields = FUZZ_fieldTypes,
+  .emit = fuzzEmit,
+};
+
+
+static void fuzzDecode(const uint8_t* data, size_t size, bool binary) {
+  if (size == 0) { return; }
+  uint16_t stepQty = 1 + (data[0] & 0x0f);
+  data++;
+  size--;
+
+  // Text payloads must be null-terminated, as tuple strings are.
+  char* buf = malloc(size + 1);
+  memcpy(buf, data, size);
+  buf[size] = '\0';
+  FuzzPayload payload = { buf, buf + size };
+
+  RecordDecoder decoder;
+  if (binary) {
+    assert(RecordDecoder_initBinary(&decoder, &fuzzSchema, (uint8_t*) buf, size, &payload) == MPA_SUCCESS);
+  } else {
+    assert(RecordDecoder_init(&decoder, &fuzzSchema, buf, size, '|', &payload) == MPA_SUCCESS);
+  }
+
+  bool done = false;
+  uint16_t prevQty = 0;
+  while (!done) {
+    if (RecordDecoder_step(&decoder, stepQty, &done) != MPA_SUCCESS) {
+      assert(done);
+      break;
+    }
+    assert(decoder.recordQty - prevQty <= stepQty);
+    prevQty = decoder.recordQty;
+  }
+  free(buf);
+}
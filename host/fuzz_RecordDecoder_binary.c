@@ -0,0 +1,8 @@
+#include "fuzz_RecordDecoder.h"
+
+// Fuzz target for RecordDecoder over length-prefixed binary records.
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  fuzzDecode(data, size, true);
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include <pebble.h>
+#include <assert.h>
+
+#include "libs/Tokenizer.h"
+
+// Fuzz target for Tokenizer.
+//
+// The input is tokenized twice. First as a raw '|'-delimited payload, with
+// the byte at each step choosing which accessor reads the next field. Then
+// its lines are treated as fields: they are escaped and joined the way the
+// phone does it, and tokenizing the result must give back every line.
+
+#define DELIM  '|'
+
+
+static void tokenizeRaw(const uint8_t* data, size_t size) {
+  char* buf = malloc(size + 1);
+  memcpy(buf, data, size);
+  buf[size] = '\0';
+
+  Tokenizer tok;
+  Tokenizer_init(&tok, buf, size, DELIM);
+  for (size_t step = 0; !Tokenizer_done(&tok); step++) {
+    StrSlice slice;
+    char* str = NULL;
+    uint32_t u32 = 0;
+    uint16_t u16 = 0;
+
+    switch (data[step % size] & 3) {
+      case 0:
+        assert(Tokenizer_nextSlice(&tok, &slice) == MPA_SUCCESS);
+        assert( (slice.str >= buf) && (slice.str + slice.len <= buf + size) );
+        break;
+      case 1:
+        assert(Tokenizer_nextStr(&tok, &str) == MPA_SUCCESS);
+        assert(str + strlen(str) <= buf + size);
+        break;
+      case 2:
+        Tokenizer_nextUInt32(&tok, &u32);
+        break;
+      default:
+        Tokenizer_nextUInt16(&tok, &u16);
+        break;
+    } // end switch
+  }
+  free(buf);
+}
+
+
+static void tokenizeEscaped(const uint8_t* data, size_t size) {
+  char* buf = malloc(2 * size + 1);
+  size_t len = 0;
+  size_t fieldQty = 1;
+
+  for (size_t i = 0; i < size; i++) {
+    char c = (data[i] == '\0') ? ' ' : (char) data[i];
+    if (c == '\n') {
+      buf[len++] = DELIM;
+      fieldQty++;
+      continue;
+    }
+    if ( (c == DELIM) || (c == TOKENIZER_ESCAPE) ) { buf[len++] = TOKENIZER_ESCAPE; }
+    buf[len++] = c;
+  }
+  buf[len] = '\0';
+
+  Tokenizer tok;
+  Tokenizer_init(&tok, buf, len, DELIM);
+  if (len == 0) {
+    assert(Tokenizer_done(&tok));
+    free(buf);
+    return;
+  }
+
+  const uint8_t* line = data;
+  for (size_t field = 0; field < fieldQty; field++) {
+    const uint8_t* lineEnd = memchr(line, '\n', data + size - line);
+    if (lineEnd == NULL) { lineEnd = data + size; }
+
+    char* str = NULL;
+    assert(Tokenizer_nextStr(&tok, &str) == MPA_SUCCESS);
+    assert(strlen(str) == (size_t)(lineEnd - line));
+    for (size_t i = 0; str[i] != '\0'; i++) {
+      assert(str[i] == ((line[i] == '\0') ? ' ' : (char) line[i]));
+    }
+    line = lineEnd + 1;
+  }
+  assert(Tokenizer_done(&tok));
+  free(buf);
+}
+
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size == 0) { return 0; }
+  tokenizeRaw(data, size);
+  tokenizeEscaped(data, size);
+  return 0;
+}
@@ -0,0 +1,32 @@
+#include <pebble.h>
+#include <assert.h>
+
+#include "baseline/data-processor.h"
+
+// Fuzz target for the data-processor library, which the inbox decoders used
+// before Tokenizer. It is driven the way they drove it: count the fields,
+// then take each one as a string or an integer.
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  char* buf = malloc(size + 1);
+  memcpy(buf, data, size);
+  buf[size] = '\0';
+
+  ProcessingState* state = data_processor_create(buf, '|');
+  assert(state != NULL);
+
+  uint16_t fieldQty = data_processor_count(state);
+  for (uint16_t field = 0; field < fieldQty; field++) {
+    if ( (field % 3) == 2 ) {
+      data_processor_get_int(state);
+    } else {
+      char* str = data_processor_get_string(state);
+      assert( (str != NULL) && (strlen(str) <= size) );
+      free(str);
+    }
+  }
+
+  data_processor_destroy(state);
+  free(buf);
+  return 0;
+}
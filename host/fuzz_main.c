@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Standalone driver for the LLVMFuzzerTestOneInput() targets, for compilers
+// without libFuzzer. Builds made with clang -fsanitize=fuzzer (or an AFL
+// compiler, which feeds inputs through a file or stdin) do not need it.
+//
+//   fuzz_X FILE...               runs each file once, as libFuzzer does
+//   fuzz_X < FILE                runs stdin once, for afl-fuzz
+//   fuzz_X -runs=N [-seed=S] [FILE...]
+//                                runs N random mutations, starting from the
+//                                files if any and from an empty input if not
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+#define MAX_INPUT  4096
+
+
+// Bytes that are significant to the record formats under test.
+static const uint8_t interesting[] = { '|', '\\', '\0', '0', '9', 'A', 'z', 0x01, 0x7f, 0xff };
+
+static uint32_t rngState = 2463534242u;
+
+static uint32_t rng(void) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+static uint8_t randomByte(void) {
+  return (rng() & 1) ? interesting[rng() % sizeof(interesting)] : (uint8_t) rng();
+}
+
+
+static size_t readFile(const char* path, uint8_t* buf, size_t cap) {
+  FILE* f = (path == NULL) ? stdin : fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  size_t len = fread(buf, 1, cap, f);
+  if (f != stdin) { fclose(f); }
+  return len;
+}
+
+
+static size_t mutate(uint8_t* buf, size_t len) {
+  size_t pos = (len == 0) ? 0 : rng() % len;
+
+  switch (rng() % 6) {
+    case 0:                                   // overwrite a byte
+      if (len > 0) { buf[pos] = randomByte(); }
+      break;
+    case 1:                                   // insert a byte
+    case 2:
+      if (len < MAX_INPUT) {
+        memmove(buf + pos + 1, buf + pos, len - pos);
+        buf[pos] = randomByte();
+        len++;
+      }
+      break;
+    case 3:                                   // delete a byte
+      if (len > 0) {
+        memmove(buf + pos, buf + pos + 1, len - pos - 1);
+        len--;
+      }
+      break;
+    case 4:                                   // repeat a run of bytes
+      if (len > 0) {
+        size_t runLen = 1 + rng() % (len - pos);
+        if (len + runLen <= MAX_INPUT) {
+          memmove(buf + pos + runLen, buf + pos, len - pos);
+          len += runLen;
+        }
+      }
+      break;
+    default:                                  // truncate
+      len = pos;
+      break;
+  } // end switch
+  return len;
+}
+
+
+int main(int argc, char** argv) {
+  static uint8_t seeds[16][MAX_INPUT];
+  static size_t seedLens[16];
+  static uint8_t buf[MAX_INPUT];
+  unsigned long runs = 0;
+  int seedQty = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "-runs=", 6) == 0) {
+      runs = strtoul(argv[i] + 6, NULL, 10);
+    } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+      rngState = (uint32_t) strtoul(argv[i] + 6, NULL, 10) | 1;
+    } else if (runs == 0) {
+      size_t len = readFile(argv[i], buf, sizeof(buf));
+      LLVMFuzzerTestOneInput(buf, len);
+    } else if (seedQty < 16) {
+      seedLens[seedQty] = readFile(argv[i], seeds[seedQty], MAX_INPUT);
+      seedQty++;
+    }
+  }
+
+  if ( (argc == 1) && !isatty(STDIN_FILENO) ) {
+    size_t len = readFile(NULL, buf, sizeof(buf));
+    LLVMFuzzerTestOneInput(buf, len);
+    return 0;
+  }
+
+  // Random walk: each input is a mutation of the previous one, restarting
+  // from a seed every so often so that inputs stay near valid records.
+  size_t len = 0;
+  for (unsigned long run = 0; run < runs; run++) {
+    if ( (run % 32) == 0 ) {
+      len = 0;
+      if (seedQty > 0) {
+        int seed = rng() % seedQty;
+        len = seedLens[seed];
+        memcpy(buf, seeds[seed], len);
+      }
+    }
+    len = mutate(buf, len);
+    LLVMFuzzerTestOneInput(buf, len);
+  }
+  if (runs > 0) { printf("%s: %lu runs\n", argv[0], runs); }
+  return 0;
+}
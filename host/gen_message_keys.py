@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+"""Generates message_keys.auto.h and message_keys.auto.c from package.json.
+
+Keys are numbered from 10000 in declaration order, as the Pebble SDK does.
+
+Usage: gen_message_keys.py PACKAGE_JSON OUT_DIR
+"""
+
+import json
+import os
+import sys
+
+FIRST_KEY = 10000
+
+
+def main(package_json, out_dir):
+    with open(package_json) as f:
+        keys = json.load(f)['pebble']['messageKeys']
+
+    with open(os.path.join(out_dir, 'message_keys.auto.h'), 'w') as h:
+        h.write('#pragma once\n\n#include <stdint.h>\n\n')
+        for key in keys:
+            h.write('extern uint32_t MESSAGE_KEY_%s;\n' % key)
+
+    with open(os.path.join(out_dir, 'message_keys.auto.c'), 'w') as c:
+        c.write('#include <string.h>\n\n#include "message_keys.auto.h"\n\n')
+        for idx, key in enumerate(keys):
+            c.write('uint32_t MESSAGE_KEY_%s = %d;\n' % (key, FIRST_KEY + idx))
+        c.write('\nstatic const char* keyNames[] = {\n')
+        for key in keys:
+            c.write('  "%s",\n' % key)
+        c.write('};\n\n')
+        c.write('const char* host_keyName(uint32_t key) {\n')
+        c.write('  if ( (key < %d) || (key >= %d) ) { return "?"; }\n' % (FIRST_KEY, FIRST_KEY + len(keys)))
+        c.write('  return keyNames[key - %d];\n}\n' % FIRST_KEY)
+        c.write('\nuint32_t host_keyByName(const char* name) {\n')
+        c.write('  for (uint32_t idx = 0; idx < %d; idx++) {\n' % len(keys))
+        c.write('    if (strcmp(keyNames[idx], name) == 0) { return %d + idx; }\n' % FIRST_KEY)
+        c.write('  }\n  return 0;\n}\n')
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit(__doc__.strip().splitlines()[-1])
+    main(sys.argv[1], sys.argv[2])
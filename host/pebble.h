@@ -0,0 +1,317 @@
+#pragma once
+
+// Host stand-in for the Pebble SDK's pebble.h.
+//
+// Declares the subset of the SDK that the app's sources use, with the
+// SDK's names and signatures, so that comm.c, the data model and the
+// libraries compile unchanged with the host compiler. pebble_host.c
+// implements these declarations on top of a simulated clock, outbox and
+// phone; see README.md.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+
+// Logging
+typedef enum {
+  APP_LOG_LEVEL_ERROR = 1,
+  APP_LOG_LEVEL_WARNING = 50,
+  APP_LOG_LEVEL_INFO = 100,
+  APP_LOG_LEVEL_DEBUG = 200,
+  APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char* src_filename, int src_line_number, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+#define APP_LOG(level, fmt, args...)  app_log(level, __FILE__, __LINE__, fmt, ## args)
+
+#define ARRAY_LENGTH(array)  (sizeof((array)) / sizeof((array)[0]))
+
+typedef int32_t status_t;
+
+
+// Dictionaries
+typedef enum {
+  TUPLE_BYTE_ARRAY = 0,
+  TUPLE_CSTRING = 1,
+  TUPLE_UINT = 2,
+  TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((__packed__)) {
+  uint32_t  key;
+  TupleType type:8;
+  uint16_t  length;
+  union {
+    uint8_t  data[0];
+    char     cstring[0];
+    uint8_t  uint8;
+    uint16_t uint16;
+    uint32_t uint32;
+    int8_t   int8;
+    int16_t  int16;
+    int32_t  int32;
+  } value[];
+} Tuple;
+
+typedef struct {
+  void*       dictionary;
+  const void* end;
+  Tuple*      cursor;
+} DictionaryIterator;
+
+typedef enum {
+  DICT_OK = 0,
+  DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+  DICT_INVALID_ARGS = 1 << 2,
+  DICT_INTERNAL_INCONSISTENCY = 1 << 3,
+  DICT_MALLOC_FAILED = 1 << 4,
+} DictionaryResult;
+
+Tuple* dict_find(const DictionaryIterator* iter, const uint32_t key);
+Tuple* dict_read_first(DictionaryIterator* iter);
+Tuple* dict_read_next(DictionaryIterator* iter);
+DictionaryResult dict_write_cstring(DictionaryIterator* iter, const uint32_t key, const char* const cstring);
+DictionaryResult dict_write_data(DictionaryIterator* iter, const uint32_t key, const uint8_t* const data,
+                                 const uint16_t size);
+DictionaryResult dict_write_uint8(DictionaryIterator* iter, const uint32_t key, const uint8_t value);
+DictionaryResult dict_write_uint16(DictionaryIterator* iter, const uint32_t key, const uint16_t value);
+DictionaryResult dict_write_uint32(DictionaryIterator* iter, const uint32_t key, const uint32_t value);
+DictionaryResult dict_write_int32(DictionaryIterator* iter, const uint32_t key, const int32_t value);
+DictionaryResult dict_write_int(DictionaryIterator* iter, const uint32_t key, const void* integer,
+                                const uint8_t width_bytes, const bool is_signed);
+uint32_t dict_size(DictionaryIterator* iter);
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+
+
+// AppMessage
+typedef enum {
+  APP_MSG_OK = 0,
+  APP_MSG_SEND_TIMEOUT = 1 << 1,
+  APP_MSG_SEND_REJECTED = 1 << 2,
+  APP_MSG_NOT_CONNECTED = 1 << 3,
+  APP_MSG_APP_NOT_RUNNING = 1 << 4,
+  APP_MSG_INVALID_ARGS = 1 << 5,
+  APP_MSG_BUSY = 1 << 6,
+  APP_MSG_BUFFER_OVERFLOW = 1 << 7,
+  APP_MSG_ALREADY_RELEASED = 1 << 9,
+  APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10,
+  APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+  APP_MSG_OUT_OF_MEMORY = 1 << 12,
+  APP_MSG_CLOSED = 1 << 13,
+  APP_MSG_INTERNAL_ERROR = 1 << 14,
+  APP_MSG_INVALID_STATE = 1 << 15,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator* iterator, void* context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason, void* context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator* iterator, void* context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator* iterator, AppMessageResult reason, void* context);
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback);
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+void app_message_deregister_callbacks(void);
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+uint32_t app_message_inbox_size_maximum(void);
+uint32_t app_message_outbox_size_maximum(void);
+AppMessageResult app_message_outbox_begin(DictionaryIterator** iterator);
+AppMessageResult app_message_outbox_send(void);
+
+typedef enum {
+  SNIFF_INTERVAL_NORMAL = 0,
+  SNIFF_INTERVAL_REDUCED = 1,
+} SniffInterval;
+
+void app_comm_set_sniff_interval(const SniffInterval interval);
+SniffInterval app_comm_get_sniff_interval(void);
+
+typedef void (*ConnectionHandler)(bool connected);
+
+typedef struct {
+  ConnectionHandler pebble_app_connection_handler;
+  ConnectionHandler pebblekit_connection_handler;
+} ConnectionHandlers;
+
+void connection_service_subscribe(ConnectionHandlers conn_handlers);
+void connection_service_unsubscribe(void);
+bool connection_service_peek_pebble_app_connection(void);
+
+
+// Timers and time
+typedef void (*AppTimerCallback)(void* data);
+typedef struct AppTimer AppTimer;
+
+AppTimer* app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void* callback_data);
+bool app_timer_reschedule(AppTimer* timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer* timer_handle);
+
+uint16_t time_ms(time_t* t_utc, uint16_t* out_ms);
+
+typedef enum {
+  SECOND_UNIT = 1 << 0,
+  MINUTE_UNIT = 1 << 1,
+  HOUR_UNIT = 1 << 2,
+  DAY_UNIT = 1 << 3,
+  MONTH_UNIT = 1 << 4,
+  YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm* tick_time, TimeUnits units_changed);
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+
+
+// Persistent storage
+#define PERSIST_DATA_MAX_LENGTH    256
+#define PERSIST_STRING_MAX_LENGTH  PERSIST_DATA_MAX_LENGTH
+
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+int persist_read_data(const uint32_t key, void* buffer, const size_t buffer_size);
+int persist_read_string(const uint32_t key, char* buffer, const size_t buffer_size);
+status_t persist_write_int(const uint32_t key, const int32_t value);
+int persist_write_data(const uint32_t key, const void* data, const size_t size);
+int persist_write_string(const uint32_t key, const char* cstring);
+status_t persist_delete(const uint32_t key);
+
+
+// Heap, UI and system services used by misc.c and main.c
+size_t heap_bytes_free(void);
+size_t heap_bytes_used(void);
+
+typedef union GColor8 {
+  uint8_t argb;
+} GColor8;
+typedef GColor8 GColor;
+
+typedef enum {
+  GTextAlignmentLeft,
+  GTextAlignmentCenter,
+  GTextAlignmentRight,
+} GTextAlignment;
+
+typedef void* GFont;
+typedef struct TextLayer TextLayer;
+
+void text_layer_set_background_color(TextLayer* text_layer, GColor color);
+void text_layer_set_text_color(TextLayer* text_layer, GColor color);
+void text_layer_set_text_alignment(TextLayer* text_layer, GTextAlignment text_alignment);
+void text_layer_set_font(TextLayer* text_layer, GFont font);
+
+void window_stack_pop_all(const bool animated);
+void vibes_double_pulse(void);
+
+
+// Windows and menus, declared so that WndDataMenu can be compile-checked;
+// nothing on the host draws. The host poses as a rectangular color watch.
+#define PBL_RECT
+#define PBL_COLOR
+#define PBL_IF_RECT_ELSE(if_true, if_false)   (if_true)
+#define PBL_IF_ROUND_ELSE(if_true, if_false)  (if_false)
+#define COLOR_FALLBACK(color, bw)             (color)
+
+#define GColorBlack     ((GColor8) { .argb = 0xc0 })
+#define GColorWhite     ((GColor8) { .argb = 0xff })
+#define GColorDarkGreen ((GColor8) { .argb = 0xc4 })
+
+typedef struct GPoint { int16_t x; int16_t y; } GPoint;
+typedef struct GSize { int16_t w; int16_t h; } GSize;
+typedef struct GRect { GPoint origin; GSize size; } GRect;
+
+typedef struct GContext GContext;
+typedef struct GBitmap GBitmap;
+typedef struct Layer Layer;
+typedef struct Window Window;
+typedef struct MenuLayer MenuLayer;
+
+typedef struct MenuIndex {
+  uint16_t section;
+  uint16_t row;
+} MenuIndex;
+
+typedef void (*WindowHandler)(Window* window);
+
+typedef struct WindowHandlers {
+  WindowHandler load;
+  WindowHandler appear;
+  WindowHandler disappear;
+  WindowHandler unload;
+} WindowHandlers;
+
+typedef uint16_t (*MenuLayerGetNumberOfSectionsCallback)(MenuLayer* menu_layer, void* callback_context);
+typedef uint16_t (*MenuLayerGetNumberOfRowsInSectionsCallback)(MenuLayer* menu_layer, uint16_t section_index,
+                                                               void* callback_context);
+typedef int16_t (*MenuLayerGetCellHeightCallback)(MenuLayer* menu_layer, MenuIndex* cell_index,
+                                                  void* callback_context);
+typedef int16_t (*MenuLayerGetHeaderHeightCallback)(MenuLayer* menu_layer, uint16_t section_index,
+                                                    void* callback_context);
+typedef int16_t (*MenuLayerGetSeparatorHeightCallback)(MenuLayer* menu_layer, MenuIndex* cell_index,
+                                                       void* callback_context);
+typedef void (*MenuLayerDrawRowCallback)(GContext* ctx, const Layer* cell_layer, MenuIndex* cell_index,
+                                         void* callback_context);
+typedef void (*MenuLayerDrawHeaderCallback)(GContext* ctx, const Layer* cell_layer, uint16_t section_index,
+                                            void* callback_context);
+typedef void (*MenuLayerDrawSeparatorCallback)(GContext* ctx, const Layer* cell_layer, MenuIndex* cell_index,
+                                               void* callback_context);
+typedef void (*MenuLayerDrawBackgroundCallback)(GContext* ctx, const Layer* bg_layer, bool highlight,
+                                                void* callback_context);
+typedef void (*MenuLayerSelectCallback)(MenuLayer* menu_layer, MenuIndex* cell_index, void* callback_context);
+typedef void (*MenuLayerSelectionChangedCallback)(MenuLayer* menu_layer, MenuIndex new_index, MenuIndex old_index,
+                                                  void* callback_context);
+typedef void (*MenuLayerSelectionWillChangeCallback)(MenuLayer* menu_layer, MenuIndex* new_index, MenuIndex old_index,
+                                                     void* callback_context);
+
+typedef struct MenuLayerCallbacks {
+  MenuLayerGetNumberOfSectionsCallback       get_num_sections;
+  MenuLayerGetNumberOfRowsInSectionsCallback get_num_rows;
+  MenuLayerGetCellHeightCallback             get_cell_height;
+  MenuLayerGetHeaderHeightCallback           get_header_height;
+  MenuLayerDrawRowCallback                   draw_row;
+  MenuLayerDrawHeaderCallback                draw_header;
+  MenuLayerSelectCallback                    select_click;
+  MenuLayerSelectCallback                    select_long_click;
+  MenuLayerSelectionChangedCallback          selection_changed;
+  MenuLayerGetSeparatorHeightCallback        get_separator_height;
+  MenuLayerDrawSeparatorCallback             draw_separator;
+  MenuLayerSelectionWillChangeCallback       selection_will_change;
+  MenuLayerDrawBackgroundCallback            draw_background;
+} MenuLayerCallbacks;
+
+#define MENU_CELL_BASIC_HEADER_HEIGHT  ((const int16_t) 16)
+
+Window* window_create(void);
+void window_destroy(Window* window);
+void window_set_window_handlers(Window* window, WindowHandlers handlers);
+Layer* window_get_root_layer(const Window* window);
+void window_set_background_color(Window* window, GColor background_color);
+void window_set_user_data(Window* window, void* data);
+void* window_get_user_data(const Window* window);
+void window_stack_push(Window* window, bool animated);
+
+GRect layer_get_bounds(const Layer* layer);
+void layer_add_child(Layer* parent, Layer* child);
+
+MenuLayer* menu_layer_create(GRect frame);
+void menu_layer_destroy(MenuLayer* menu_layer);
+Layer* menu_layer_get_layer(const MenuLayer* menu_layer);
+void menu_layer_set_callbacks(MenuLayer* menu_layer, void* callback_context, MenuLayerCallbacks callbacks);
+void menu_layer_set_click_config_onto_window(MenuLayer* menu_layer, Window* window);
+void menu_layer_reload_data(MenuLayer* menu_layer);
+void menu_layer_set_normal_colors(MenuLayer* menu_layer, GColor background, GColor foreground);
+void menu_layer_set_highlight_colors(MenuLayer* menu_layer, GColor background, GColor foreground);
+void menu_cell_basic_draw(GContext* ctx, const Layer* cell_layer, const char* title, const char* subtitle,
+                          GBitmap* icon);
+void menu_cell_basic_header_draw(GContext* ctx, const Layer* cell_layer, const char* title);
+
+
+// MESSAGE_KEY_* constants, generated from package.json by the Makefile
+#include "message_keys.auto.h"
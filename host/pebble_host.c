@@ -0,0 +1,471 @@
+#include <pebble.h>
+#include <stdarg.h>
+
+#include "pebble_host.h"
+
+
+// Laid out like the SDK's serialized dictionaries: a tuple count followed by
+// packed tuples.
+typedef struct __attribute__((__packed__)) Dictionary {
+  uint8_t count;
+  Tuple   head[];
+} Dictionary;
+
+#define HOST_INBOX_SIZE   2026
+#define HOST_OUTBOX_SIZE  656
+#define HOST_BUF_SIZE     4096
+#define HOST_TIMER_QTY    256
+#define HOST_PERSIST_QTY  64
+
+
+static bool verbose = false;
+// Arbitrary nonzero start, so that no timestamp is mistaken for "never".
+static uint32_t now = 1000000;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Dictionaries
+/////////////////////////////////////////////////////////////////////////////
+
+static Tuple* tupleAfter(const Tuple* tuple) {
+  return (Tuple*) ((uint8_t*) tuple + sizeof(Tuple) + tuple->length);
+}
+
+static void dictBegin(DictionaryIterator* iter, uint8_t* buf, size_t size) {
+  iter->dictionary = buf;
+  iter->end = buf + size;
+  ((Dictionary*) buf)->count = 0;
+  iter->cursor = ((Dictionary*) buf)->head;
+}
+
+static void dictOpen(DictionaryIterator* iter, uint8_t* buf, size_t len) {
+  iter->dictionary = buf;
+  iter->end = buf + len;
+  iter->cursor = ((Dictionary*) buf)->head;
+}
+
+static size_t dictLen(const DictionaryIterator* iter) {
+  return (uint8_t*) iter->cursor - (uint8_t*) iter->dictionary;
+}
+
+static DictionaryResult dictWrite(DictionaryIterator* iter, uint32_t key, TupleType type, const void* data,
+                                  size_t len) {
+  if ( (iter == NULL) || (len > UINT16_MAX) ) { return DICT_INVALID_ARGS; }
+  if ((uint8_t*) iter->cursor + sizeof(Tuple) + len > (uint8_t*) iter->end) { return DICT_NOT_ENOUGH_STORAGE; }
+
+  Tuple* tuple = iter->cursor;
+  tuple->key = key;
+  tuple->type = type;
+  tuple->length = len;
+  if (len > 0) { memcpy(tuple->value->data, data, len); }
+  ((Dictionary*) iter->dictionary)->count++;
+  iter->cursor = tupleAfter(tuple);
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator* iter, const uint32_t key, const char* const cstring) {
+  if (cstring == NULL) { return dictWrite(iter, key, TUPLE_CSTRING, "", 1); }
+  return dictWrite(iter, key, TUPLE_CSTRING, cstring, strlen(cstring) + 1);
+}
+
+DictionaryResult dict_write_data(DictionaryIterator* iter, const uint32_t key, const uint8_t* const data,
+                                 const uint16_t size) {
+  return dictWrite(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator* iter, const uint32_t key, const uint8_t value) {
+  return dictWrite(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+DictionaryResult dict_write_uint16(DictionaryIterator* iter, const uint32_t key, const uint16_t value) {
+  return dictWrite(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+DictionaryResult dict_write_uint32(DictionaryIterator* iter, const uint32_t key, const uint32_t value) {
+  return dictWrite(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+DictionaryResult dict_write_int32(DictionaryIterator* iter, const uint32_t key, const int32_t value) {
+  return dictWrite(iter, key, TUPLE_INT, &value, sizeof(value));
+}
+
+DictionaryResult dict_write_int(DictionaryIterator* iter, const uint32_t key, const void* integer,
+                                const uint8_t width_bytes, const bool is_signed) {
+  return dictWrite(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+
+uint32_t dict_size(DictionaryIterator* iter) {
+  return dictLen(iter);
+}
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+  va_list args;
+  uint32_t size = sizeof(Dictionary);
+
+  va_start(args, tuple_count);
+  for (uint8_t i = 0; i < tuple_count; i++) {
+    size += sizeof(Tuple) + va_arg(args, uint32_t);
+  }
+  va_end(args);
+  return size;
+}
+
+Tuple* dict_read_first(DictionaryIterator* iter) {
+  Dictionary* dict = iter->dictionary;
+  if (dict->count == 0) { return NULL; }
+  iter->cursor = dict->head;
+  return iter->cursor;
+}
+
+Tuple* dict_read_next(DictionaryIterator* iter) {
+  Tuple* next = tupleAfter(iter->cursor);
+  if ((uint8_t*) next >= (uint8_t*) iter->end) { return NULL; }
+  iter->cursor = next;
+  return next;
+}
+
+Tuple* dict_find(const DictionaryIterator* iter, const uint32_t key) {
+  Dictionary* dict = iter->dictionary;
+  Tuple* tuple = dict->head;
+  for (uint8_t i = 0; i < dict->count; i++, tuple = tupleAfter(tuple)) {
+    if (tuple->key == key) { return tuple; }
+  }
+  return NULL;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// AppMessage
+/////////////////////////////////////////////////////////////////////////////
+
+static AppMessageInboxReceived inboxReceived = NULL;
+static AppMessageInboxDropped inboxDropped = NULL;
+static AppMessageOutboxSent outboxSent = NULL;
+static AppMessageOutboxFailed outboxFailed = NULL;
+
+static uint32_t outboxSize = 0;
+static uint8_t outboxBuf[HOST_BUF_SIZE];
+static DictionaryIterator outboxIter;
+static HostOutbox outboxState = HOST_OUTBOX_IDLE;
+static AppMessageResult beginResult = APP_MSG_OK;
+static AppMessageResult sendResult = APP_MSG_OK;
+static uint8_t sentBuf[HOST_BUF_SIZE];
+static size_t sentLen = 0;
+static int sendQty = 0;
+
+static uint8_t inboxBuf[HOST_BUF_SIZE];
+static DictionaryIterator inboxIter;
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback) {
+  AppMessageInboxReceived prev = inboxReceived;
+  inboxReceived = received_callback;
+  return prev;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback) {
+  AppMessageInboxDropped prev = inboxDropped;
+  inboxDropped = dropped_callback;
+  return prev;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+  AppMessageOutboxSent prev = outboxSent;
+  outboxSent = sent_callback;
+  return prev;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+  AppMessageOutboxFailed prev = outboxFailed;
+  outboxFailed = failed_callback;
+  return prev;
+}
+
+void app_message_deregister_callbacks(void) {
+  inboxReceived = NULL;
+  inboxDropped = NULL;
+  outboxSent = NULL;
+  outboxFailed = NULL;
+}
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+  if ( (size_inbound > HOST_INBOX_SIZE) || (size_outbound > HOST_OUTBOX_SIZE) ) { return APP_MSG_OUT_OF_MEMORY; }
+  outboxSize = size_outbound;
+  return APP_MSG_OK;
+}
+
+uint32_t app_message_inbox_size_maximum(void) { return HOST_INBOX_SIZE; }
+uint32_t app_message_outbox_size_maximum(void) { return HOST_OUTBOX_SIZE; }
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator** iterator) {
+  if (beginResult != APP_MSG_OK) { return beginResult; }
+  if (outboxState != HOST_OUTBOX_IDLE) { return APP_MSG_BUSY; }
+  dictBegin(&outboxIter, outboxBuf, (outboxSize > 0) ? outboxSize : HOST_OUTBOX_SIZE);
+  outboxState = HOST_OUTBOX_BEGUN;
+  *iterator = &outboxIter;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if (outboxState != HOST_OUTBOX_BEGUN) { return APP_MSG_INVALID_STATE; }
+  if (sendResult != APP_MSG_OK) {
+    outboxState = HOST_OUTBOX_IDLE;
+    return sendResult;
+  }
+  sentLen = dictLen(&outboxIter);
+  memcpy(sentBuf, outboxBuf, sentLen);
+  outboxState = HOST_OUTBOX_SENT;
+  sendQty++;
+  return APP_MSG_OK;
+}
+
+HostOutbox host_outboxState(void) { return outboxState; }
+int host_sendQty(void) { return sendQty; }
+void host_failBegin(AppMessageResult result) { beginResult = result; }
+void host_failSend(AppMessageResult result) { sendResult = result; }
+
+void host_lastSent(DictionaryIterator* iter) {
+  dictOpen(iter, sentBuf, sentLen);
+}
+
+void host_ack(void) {
+  DictionaryIterator iter;
+  host_lastSent(&iter);
+  outboxState = HOST_OUTBOX_IDLE;
+  if (outboxSent != NULL) { outboxSent(&iter, NULL); }
+}
+
+void host_nack(AppMessageResult reason) {
+  DictionaryIterator iter;
+  host_lastSent(&iter);
+  outboxState = HOST_OUTBOX_IDLE;
+  if (outboxFailed != NULL) { outboxFailed(&iter, reason, NULL); }
+}
+
+void host_inboxBegin(DictionaryIterator** iter) {
+  dictBegin(&inboxIter, inboxBuf, HOST_INBOX_SIZE);
+  *iter = &inboxIter;
+}
+
+void host_inboxDeliver(void) {
+  DictionaryIterator iter;
+  dictOpen(&iter, inboxBuf, dictLen(&inboxIter));
+  if (inboxReceived != NULL) { inboxReceived(&iter, NULL); }
+}
+
+void host_printDict(const char* label, DictionaryIterator* iter) {
+  printf("%s {", label);
+  for (Tuple* tuple = dict_read_first(iter); tuple != NULL; tuple = dict_read_next(iter)) {
+    printf(" %s=", host_keyName(tuple->key));
+    switch (tuple->type) {
+      case TUPLE_CSTRING:    printf("\"%s\"", tuple->value->cstring); break;
+      case TUPLE_BYTE_ARRAY: printf("[%u bytes]", tuple->length); break;
+      default:
+        printf("%u", (tuple->length == 1) ? tuple->value->uint8 :
+                     (tuple->length == 2) ? tuple->value->uint16 : tuple->value->uint32);
+        break;
+    } // end switch
+  }
+  printf(" }\n");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Connection and sniff interval
+/////////////////////////////////////////////////////////////////////////////
+
+static ConnectionHandlers connHandlers;
+static bool connected = true;
+static SniffInterval sniffInterval = SNIFF_INTERVAL_NORMAL;
+
+void connection_service_subscribe(ConnectionHandlers conn_handlers) { connHandlers = conn_handlers; }
+void connection_service_unsubscribe(void) { memset(&connHandlers, 0, sizeof(connHandlers)); }
+bool connection_service_peek_pebble_app_connection(void) { return connected; }
+
+void host_setConnected(bool isConnected) {
+  connected = isConnected;
+  if (connHandlers.pebble_app_connection_handler != NULL) { connHandlers.pebble_app_connection_handler(connected); }
+}
+
+void app_comm_set_sniff_interval(const SniffInterval interval) { sniffInterval = interval; }
+SniffInterval app_comm_get_sniff_interval(void) { return sniffInterval; }
+SniffInterval host_sniffInterval(void) { return sniffInterval; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Timers and time
+/////////////////////////////////////////////////////////////////////////////
+
+struct AppTimer {
+  uint32_t         due;
+  AppTimerCallback callback;
+  void*            data;
+  bool             live;
+};
+
+static struct AppTimer timers[HOST_TIMER_QTY];
+
+AppTimer* app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void* callback_data) {
+  for (size_t i = 0; i < HOST_TIMER_QTY; i++) {
+    if (!timers[i].live) {
+      timers[i] = (struct AppTimer) { now + timeout_ms, callback, callback_data, true };
+      return &timers[i];
+    }
+  }
+  return NULL;
+}
+
+bool app_timer_reschedule(AppTimer* timer_handle, uint32_t new_timeout_ms) {
+  if ( (timer_handle == NULL) || !timer_handle->live) { return false; }
+  timer_handle->due = now + new_timeout_ms;
+  return true;
+}
+
+void app_timer_cancel(AppTimer* timer_handle) {
+  if (timer_handle != NULL) { timer_handle->live = false; }
+}
+
+uint32_t host_now(void) { return now; }
+
+void host_advance(uint32_t ms) {
+  uint32_t end = now + ms;
+
+  for (;;) {
+    struct AppTimer* next = NULL;
+    for (size_t i = 0; i < HOST_TIMER_QTY; i++) {
+      if ( timers[i].live && (timers[i].due <= end) && ((next == NULL) || (timers[i].due < next->due)) ) {
+        next = &timers[i];
+      }
+    }
+    if (next == NULL) { break; }
+    if (next->due > now) { now = next->due; }
+    next->live = false;
+    next->callback(next->data);
+  }
+  now = end;
+}
+
+int host_liveTimers(void) {
+  int qty = 0;
+  for (size_t i = 0; i < HOST_TIMER_QTY; i++) {
+    if (timers[i].live) { qty++; }
+  }
+  return qty;
+}
+
+uint16_t time_ms(time_t* t_utc, uint16_t* out_ms) {
+  if (t_utc != NULL) { *t_utc = now / 1000; }
+  if (out_ms != NULL) { *out_ms = now % 1000; }
+  return now % 1000;
+}
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+  (void) tick_units;
+  (void) handler;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Persistent storage
+/////////////////////////////////////////////////////////////////////////////
+
+static struct {
+  bool     live;
+  uint32_t key;
+  size_t   size;
+  uint8_t  data[PERSIST_DATA_MAX_LENGTH];
+} store[HOST_PERSIST_QTY];
+
+static int persistFind(uint32_t key) {
+  for (int i = 0; i < HOST_PERSIST_QTY; i++) {
+    if (store[i].live && (store[i].key == key)) { return i; }
+  }
+  return -1;
+}
+
+bool persist_exists(const uint32_t key) {
+  return (persistFind(key) >= 0);
+}
+
+int persist_get_size(const uint32_t key) {
+  int i = persistFind(key);
+  return (i < 0) ? -1 : (int) store[i].size;
+}
+
+int persist_read_data(const uint32_t key, void* buffer, const size_t buffer_size) {
+  int i = persistFind(key);
+  if (i < 0) { return -1; }
+  size_t len = (buffer_size < store[i].size) ? buffer_size : store[i].size;
+  memcpy(buffer, store[i].data, len);
+  return len;
+}
+
+int persist_read_string(const uint32_t key, char* buffer, const size_t buffer_size) {
+  return persist_read_data(key, buffer, buffer_size);
+}
+
+int32_t persist_read_int(const uint32_t key) {
+  int32_t value = 0;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+int persist_write_data(const uint32_t key, const void* data, const size_t size) {
+  if (size > PERSIST_DATA_MAX_LENGTH) { return -1; }
+  int i = persistFind(key);
+  for (int free = 0; (i < 0) && (free < HOST_PERSIST_QTY); free++) {
+    if (!store[free].live) { i = free; }
+  }
+  if (i < 0) { return -1; }
+  store[i].live = true;
+  store[i].key = key;
+  store[i].size = size;
+  memcpy(store[i].data, data, size);
+  return size;
+}
+
+int persist_write_string(const uint32_t key, const char* cstring) {
+  return persist_write_data(key, cstring, strlen(cstring) + 1);
+}
+
+status_t persist_write_int(const uint32_t key, const int32_t value) {
+  return persist_write_data(key, &value, sizeof(value));
+}
+
+status_t persist_delete(const uint32_t key) {
+  int i = persistFind(key);
+  if (i >= 0) { store[i].live = false; }
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Logging, heap and UI
+/////////////////////////////////////////////////////////////////////////////
+
+void host_setVerbose(bool isVerbose) { verbose = isVerbose; }
+
+void app_log(uint8_t log_level, const char* src_filename, int src_line_number, const char* fmt, ...) {
+  (void) log_level;
+  if (!verbose) { return; }
+
+  va_list args;
+  va_start(args, fmt);
+  printf("    [%s:%d] ", src_filename, src_line_number);
+  vprintf(fmt, args);
+  printf("\n");
+  va_end(args);
+}
+
+size_t heap_bytes_free(void) { return 0; }
+size_t heap_bytes_used(void) { return 0; }
+
+void text_layer_set_background_color(TextLayer* text_layer, GColor color) { (void) text_layer; (void) color; }
+void text_layer_set_text_color(TextLayer* text_layer, GColor color) { (void) text_layer; (void) color; }
+void text_layer_set_text_alignment(TextLayer* text_layer, GTextAlignment text_alignment) {
+  (void) text_layer;
+  (void) text_alignment;
+}
+void text_layer_set_font(TextLayer* text_layer, GFont font) { (void) text_layer; (void) font; }
+
+void window_stack_pop_all(const bool animated) { (void) animated; }
+void vibes_double_pulse(void) { }
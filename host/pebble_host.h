@@ -0,0 +1,65 @@
+#pragma once
+
+#include <pebble.h>
+
+// Controls for the simulated runtime in pebble_host.c. A host program plays
+// the phone: it reads what the watch put in the outbox, acknowledges or
+// rejects it, delivers inbox messages and moves the clock forward. Timers
+// fire only from host_advance(), in due order, so runs are deterministic.
+
+
+// Simulated clock, in milliseconds.
+uint32_t host_now(void);
+
+// Advances the clock by ms, firing every timer that falls due on the way.
+void host_advance(uint32_t ms);
+
+// Number of timers that are registered and have not fired or been cancelled.
+int host_liveTimers(void);
+
+
+typedef enum HostOutbox {
+  HOST_OUTBOX_IDLE = 0,     ///< no dictionary is open
+  HOST_OUTBOX_BEGUN,        ///< app_message_outbox_begin() succeeded, not yet sent
+  HOST_OUTBOX_SENT,         ///< sent and waiting for host_ack() or host_nack()
+} HostOutbox;
+
+HostOutbox host_outboxState(void);
+
+// Number of dictionaries sent since the app started.
+int host_sendQty(void);
+
+// Points iter at a copy of the last dictionary sent, which stays valid
+// until the next one is sent.
+void host_lastSent(DictionaryIterator* iter);
+
+// Completes the outstanding send with outbox_sent or outbox_failed.
+void host_ack(void);
+void host_nack(AppMessageResult reason);
+
+// Makes subsequent app_message_outbox_begin() or app_message_outbox_send()
+// calls fail with the specified result; APP_MSG_OK restores them.
+void host_failBegin(AppMessageResult result);
+void host_failSend(AppMessageResult result);
+
+// Starts an inbox message; write tuples into iter, then deliver it.
+void host_inboxBegin(DictionaryIterator** iter);
+void host_inboxDeliver(void);
+
+// Changes whether the phone app is connected, notifying subscribers.
+void host_setConnected(bool connected);
+
+SniffInterval host_sniffInterval(void);
+
+// Prints every tuple of a dictionary on one line, for tracing.
+void host_printDict(const char* label, DictionaryIterator* iter);
+
+// Whether APP_LOG output is printed. Off by default.
+void host_setVerbose(bool verbose);
+
+// Name of the message key with the specified value, or "?".
+const char* host_keyName(uint32_t key);
+
+// Value of the message key with the specified name, or 0 if the tree being
+// built has no such key.
+uint32_t host_keyByName(const char* name);
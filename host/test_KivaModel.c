@@ -0,0 +1,74 @@
+#include <pebble.h>
+#include <assert.h>
+
+#include "data/KivaModel.h"
+
+// Exercises the model's lifecycle under AddressSanitizer, which fills new
+// allocations with garbage: a model must not read members it has not
+// initialized, and teardown must not touch records it has freed. Uses only
+// API that predates the single-copy loan payloads, so that it also runs
+// against older trees (see README.md).
+
+
+static void test_createWithLender(void) {
+  KivaModel* model = KivaModel_create("bob");
+  assert(model != NULL);
+
+  char* lenderId = NULL;
+  assert(KivaModel_getLenderId(model, &lenderId) == MPA_SUCCESS);
+  assert(strcmp(lenderId, "bob") == 0);
+
+  int qty = -1;
+  assert(KivaModel_getKivaCountryQty(model, &qty) == MPA_SUCCESS);
+  assert(qty == 0);
+  assert(KivaModel_destroy(model) == MPA_SUCCESS);
+}
+
+
+static void test_changeLenderKeepsCountries(void) {
+  KivaModel* model = KivaModel_create("bob");
+  assert(KivaModel_addKivaCountry(model, "KE", "Kenya") == MPA_SUCCESS);
+  assert(KivaModel_addKivaCountry(model, "PE", "Peru") == MPA_SUCCESS);
+  assert(KivaModel_addLenderCountry(model, "KE", "Kenya") == MPA_SUCCESS);
+  assert(KivaModel_setLenderId(model, "alice") == MPA_SUCCESS);
+
+  int qty = -1;
+  assert(KivaModel_getKivaCountryQty(model, &qty) == MPA_SUCCESS);
+  assert(qty == 2);
+  assert(KivaModel_getLenderCountryQty(model, &qty) == MPA_SUCCESS);
+  assert(qty == 0);
+  assert(KivaModel_destroy(model) == MPA_SUCCESS);
+}
+
+
+static void test_teardownWithRecords(void) {
+  KivaModel* model = KivaModel_create("bob");
+  assert(KivaModel_addKivaCountry(model, "KE", "Kenya") == MPA_SUCCESS);
+  assert(KivaModel_addKivaCountry(model, "PE", "Peru") == MPA_SUCCESS);
+  assert(KivaModel_addKivaCountry(model, "US", "United States") == MPA_SUCCESS);
+
+  for (uint32_t id = 1; id <= 3; id++) {
+    LoanInfo loan = { .id = id, .name = "Ann", .use = "Cows", .countryCode = "KE", .fundedAmt = 50, .loanAmt = 100 };
+    assert(KivaModel_addPreferredLoan(model, loan) == MPA_SUCCESS);
+  }
+  uint16_t loanQty = 0;
+  assert(KivaModel_getPreferredLoanQty(model, &loanQty) == MPA_SUCCESS);
+  assert(loanQty == 3);
+
+  assert(KivaModel_clearPreferredLoans(model) == MPA_SUCCESS);
+  assert(KivaModel_getPreferredLoanQty(model, &loanQty) == MPA_SUCCESS);
+  assert(loanQty == 0);
+
+  LoanInfo loan = { .id = 4, .name = "Bo", .use = "Seeds", .countryCode = "PE", .fundedAmt = 0, .loanAmt = 25 };
+  assert(KivaModel_addPreferredLoan(model, loan) == MPA_SUCCESS);
+  assert(KivaModel_destroy(model) == MPA_SUCCESS);
+}
+
+
+int main(void) {
+  test_createWithLender();
+  test_changeLenderKeepsCountries();
+  test_teardownWithRecords();
+  printf("test_KivaModel: ok\n");
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <pebble.h>
+#include <assert.h>
+
+#include "data/KivaModel_Internal.h"
+
+// Storage for preferred loans must not outlive the loans that borrow from
+// it: deltas that replace or remove every loan of an earlier chunk free
+// that chunk's PayloadBuf without waiting for the next full generation.
+
+
+static int bufQty(const KivaModel* model) {
+  int qty = 0;
+  for (const PayloadBuf* buf = model->prefLoanBufs; buf != NULL; buf = buf->next) { qty++; }
+  return qty;
+}
+
+
+// Adds a chunk of loans whose strings all point into one PayloadBuf, the
+// way the LOAN_SET decoder does.
+static void addChunk(KivaModel* model, const uint32_t* ids, size_t idQty) {
+  char* buf = NULL;
+  assert(KivaModel_allocPrefLoanBuf(model, 16, &buf) == MPA_SUCCESS);
+  strcpy(buf, "Ann");
+  strcpy(buf + 4, "Cows");
+  for (size_t i = 0; i < idQty; i++) {
+    LoanInfo loan = { .id = ids[i], .name = buf, .use = buf + 4, .countryCode = "KE", .fundedAmt = 50, .loanAmt = 100 };
+    assert(KivaModel_addPreferredLoanRef(model, loan) == MPA_SUCCESS);
+  }
+  assert(KivaModel_releasePrefLoanBuf(model, buf) == MPA_SUCCESS);
+}
+
+
+static void test_deltasFreeSupersededChunks(void) {
+  KivaModel* model = KivaModel_create("bob");
+
+  addChunk(model, (uint32_t[]) { 1, 2 }, 2);
+  assert(bufQty(model) == 1);
+
+  // Loan 2 still borrows from the first chunk.
+  addChunk(model, (uint32_t[]) { 1 }, 1);
+  assert(bufQty(model) == 2);
+
+  addChunk(model, (uint32_t[]) { 2 }, 1);
+  assert(bufQty(model) == 2);
+
+  assert(KivaModel_removePreferredLoan(model, 1) == MPA_SUCCESS);
+  assert(bufQty(model) == 1);
+
+  // Many deltas in one generation hold no more than the live loans need.
+  for (int delta = 0; delta < 100; delta++) {
+    addChunk(model, (uint32_t[]) { 2, 3 }, 2);
+  }
+  assert(bufQty(model) == 1);
+
+  uint16_t loanQty = 0;
+  assert(KivaModel_getPreferredLoanQty(model, &loanQty) == MPA_SUCCESS);
+  assert(loanQty == 2);
+  assert(KivaModel_destroy(model) == MPA_SUCCESS);
+}
+
+
+static void test_emptyChunkIsFreedOnRelease(void) {
+  KivaModel* model = KivaModel_create("bob");
+
+  addChunk(model, NULL, 0);
+  assert(bufQty(model) == 0);
+  assert(KivaModel_destroy(model) == MPA_SUCCESS);
+}
+
+
+static void test_copiedLoansFreeOnReplace(void) {
+  KivaModel* model = KivaModel_create("bob");
+
+  for (int i = 0; i < 10; i++) {
+    LoanInfo loan = { .id = 7, .name = "Ann", .use = "Cows", .countryCode = "KE", .fundedAmt = 50, .loanAmt = 100 };
+    assert(KivaModel_addPreferredLoan(model, loan) == MPA_SUCCESS);
+  }
+  assert(bufQty(model) == 1);
+  assert(KivaModel_clearPreferredLoans(model) == MPA_SUCCESS);
+  assert(bufQty(model) == 0);
+  assert(KivaModel_destroy(model) == MPA_SUCCESS);
+}
+
+
+int main(void) {
+  test_deltasFreeSupersededChunks();
+  test_emptyChunkIsFreedOnRelease();
+  test_copiedLoansFreeOnReplace();
+  printf("test_PrefLoanBufs: ok\n");
+  return 0;
+}
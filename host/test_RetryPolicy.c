@@ -0,0 +1,95 @@
+#include <pebble.h>
+#include <assert.h>
+
+#include "pebble_host.h"
+#include "libs/RetryPolicy.h"
+
+// An item is abandoned only when it has used up its attempts. A spent retry
+// budget makes it wait for a success or for the cooldown instead.
+
+
+static const RetryClassConfig classes[] = {
+  { .baseMs = 100, .maxMs = 400, .maxAttempts = 3 },
+};
+static const RetryLimits limits = { .breakerThreshold = 0, .breakerCooldownMs = 5000, .budget = 1 };
+
+static int retryQty;
+
+static void onRetry(void* context) {
+  (void) context;
+  retryQty++;
+}
+
+
+static void test_spentBudgetWaitsForCooldown(void) {
+  RetryPolicy* policy = RetryPolicy_create(classes, ARRAY_LENGTH(classes), limits, onRetry, NULL);
+  uint8_t attempts = 0;
+  bool retry = false;
+  retryQty = 0;
+
+  assert(RetryPolicy_failed(policy, 0, &attempts, &retry) == MPA_SUCCESS);
+  assert(retry && (attempts == 1));
+  host_advance(400);
+  assert(retryQty == 1);
+
+  // The budget is spent: the item waits, and the wait is not an attempt.
+  assert(RetryPolicy_failed(policy, 0, &attempts, &retry) == MPA_SUCCESS);
+  assert(retry && (attempts == 1));
+  assert(RetryPolicy_waiting(policy));
+  host_advance(4999);
+  assert(retryQty == 1);
+  host_advance(1);
+  assert(retryQty == 2);
+
+  // The cooldown earned back one retry.
+  assert(RetryPolicy_failed(policy, 0, &attempts, &retry) == MPA_SUCCESS);
+  assert(retry && (attempts == 2));
+  host_advance(400);
+  assert(retryQty == 3);
+  assert(RetryPolicy_destroy(policy) == MPA_SUCCESS);
+}
+
+
+static void test_successEndsWait(void) {
+  RetryPolicy* policy = RetryPolicy_create(classes, ARRAY_LENGTH(classes), limits, onRetry, NULL);
+  uint8_t attempts = 0;
+  bool retry = false;
+  retryQty = 0;
+
+  assert(RetryPolicy_failed(policy, 0, &attempts, &retry) == MPA_SUCCESS);
+  host_advance(400);
+  assert(RetryPolicy_failed(policy, 0, &attempts, &retry) == MPA_SUCCESS);
+  assert(retry && RetryPolicy_waiting(policy));
+
+  assert(RetryPolicy_succeeded(policy) == MPA_SUCCESS);
+  host_advance(0);
+  assert(retryQty == 2);
+  assert(!RetryPolicy_waiting(policy));
+  assert(RetryPolicy_destroy(policy) == MPA_SUCCESS);
+}
+
+
+static void test_abandonAfterMaxAttempts(void) {
+  RetryPolicy* policy = RetryPolicy_create(classes, ARRAY_LENGTH(classes), limits, onRetry, NULL);
+  uint8_t attempts = 0;
+  bool retry = false;
+
+  for (int failure = 0; ; failure++) {
+    assert(failure < 10);
+    assert(RetryPolicy_failed(policy, 0, &attempts, &retry) == MPA_SUCCESS);
+    if (!retry) { break; }
+    host_advance(5000);
+  }
+  assert(attempts == classes[0].maxAttempts);
+  assert(RetryPolicy_destroy(policy) == MPA_SUCCESS);
+}
+
+
+int main(void) {
+  test_spentBudgetWaitsForCooldown();
+  test_successEndsWait();
+  test_abandonAfterMaxAttempts();
+  assert(host_liveTimers() == 0);
+  printf("test_RetryPolicy: ok\n");
+  return 0;
+}
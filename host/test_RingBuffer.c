@@ -0,0 +1,96 @@
+#include <pebble.h>
+#include <assert.h>
+
+#include "libs/RingBuffer.h"
+
+// Capacities that are not powers of two must hold exactly that many
+// elements, and positions must stay in order across wraparound.
+
+
+static void test_capacityNotPowerOfTwo(void) {
+  static int items[10];
+  RingBuffer* rb = RingBuffer_create(10);
+  assert(rb != NULL);
+
+  for (int i = 0; i < 10; i++) {
+    assert(RingBuffer_write(rb, &items[i]) == MPA_SUCCESS);
+  }
+  bool full = false;
+  assert(RingBuffer_full(rb, &full) == MPA_SUCCESS);
+  assert(full);
+  assert(RingBuffer_write(rb, &items[0]) == MPA_FULL_ERR);
+
+  size_t qty = 0;
+  assert(RingBuffer_count(rb, &qty) == MPA_SUCCESS);
+  assert(qty == 10);
+  assert(RingBuffer_destroy(rb) == MPA_SUCCESS);
+}
+
+
+static void test_wraparound(void) {
+  static int items[40];
+  RingBuffer* rb = RingBuffer_create(3);
+  void* data = NULL;
+
+  // Advance the start through every slot, several times over.
+  for (int i = 0; i < 40; i++) {
+    assert(RingBuffer_write(rb, &items[i]) == MPA_SUCCESS);
+    if (i >= 2) {
+      assert(RingBuffer_peekAt(rb, 2, &data) == MPA_SUCCESS);
+      assert(data == &items[i]);
+      assert(RingBuffer_read(rb, &data) == MPA_SUCCESS);
+      assert(data == &items[i - 2]);
+    }
+  }
+  assert(RingBuffer_peekAt(rb, 2, &data) == MPA_EMPTY_ERR);
+  assert(data == NULL);
+  assert(RingBuffer_destroy(rb) == MPA_SUCCESS);
+}
+
+
+static void test_removeAt(void) {
+  static int items[8];
+  RingBuffer* rb = RingBuffer_create(5);
+  void* data = NULL;
+
+  // Start part way through the slots, so that the removal crosses the end.
+  for (int i = 0; i < 3; i++) {
+    assert(RingBuffer_write(rb, &items[7]) == MPA_SUCCESS);
+    assert(RingBuffer_drop(rb) == MPA_SUCCESS);
+  }
+  for (int i = 0; i < 5; i++) {
+    assert(RingBuffer_write(rb, &items[i]) == MPA_SUCCESS);
+  }
+
+  assert(RingBuffer_removeAt(rb, 1, &data) == MPA_SUCCESS);
+  assert(data == &items[1]);
+  assert(RingBuffer_removeAt(rb, 4, &data) == MPA_EMPTY_ERR);
+  assert(data == NULL);
+
+  int expected[] = { 0, 2, 3, 4 };
+  for (size_t i = 0; i < ARRAY_LENGTH(expected); i++) {
+    assert(RingBuffer_read(rb, &data) == MPA_SUCCESS);
+    assert(data == &items[expected[i]]);
+  }
+  bool empty = false;
+  assert(RingBuffer_empty(rb, &empty) == MPA_SUCCESS);
+  assert(empty);
+  assert(RingBuffer_read(rb, &data) == MPA_EMPTY_ERR);
+  assert(RingBuffer_destroy(rb) == MPA_SUCCESS);
+}
+
+
+static void test_invalidCapacity(void) {
+  assert(RingBuffer_create(0) == NULL);
+  assert(RingBuffer_create(SIZE_MAX) == NULL);
+}
+
+
+int main(void) {
+  test_capacityNotPowerOfTwo();
+  test_wraparound();
+  test_removeAt();
+  test_invalidCapacity();
+  printf("test_RingBuffer: ok\n");
+  return 0;
+}
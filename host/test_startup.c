@@ -0,0 +1,154 @@
+#include <pebble.h>
+#include <assert.h>
+
+#include "pebble_host.h"
+#include "comm.h"
+
+// Startup against a simulated phone. The phone acknowledges every
+// dictionary after 50 ms and answers each request after a typical Kiva API
+// latency: the Kiva country list (partner pages) after 2.5 s, the lender
+// profile after 0.7 s, the lender's countries (lender loans) after 1.5 s
+// and the loan search after 1 s. Reports the time from comm_open to the
+// first loan list reaching the model.
+//
+// The phone announces protocol version 2 by default, and that it handles
+// several requests in one dictionary (PROTO_CAP_BATCHED). With -protocol=1 it
+// plays a script from before the PEBKIT_READY handshake instead, which acts
+// on one request per dictionary and knows none of the handshake keys.
+
+#define ACK_DELAY_MS   50
+#define TIME_LIMIT_MS  30000
+#define TICK_MS        10
+
+typedef struct Response {
+  uint32_t due;             ///< simulated time to deliver at, or 0 once delivered
+  uint32_t key;             ///< request being answered
+  uint16_t requestId;       ///< REQUEST_ID of the request, or 0
+} Response;
+
+static Response responses[64];
+static size_t responseQty = 0;
+static uint32_t firstLoansAt = 0;
+static const KivaModel* lastModel = NULL;
+static int protocol = 2;
+
+// ProtocolCaps of the simulated phone; it answers in the text encoding.
+#define PHONE_CAPS  (1 << 5)
+
+
+static void updateViewClock(struct tm* tick_time) {
+  (void) tick_time;
+}
+
+static void updateViewData(const KivaModel* model) {
+  uint16_t loanQty = 0;
+  lastModel = model;
+  KivaModel_getPreferredLoanQty(model, &loanQty);
+  if ( (loanQty > 0) && (firstLoansAt == 0) ) { firstLoansAt = host_now(); }
+}
+
+
+static void respondLater(uint32_t delay, uint32_t key, uint16_t requestId) {
+  assert(responseQty < ARRAY_LENGTH(responses));
+  responses[responseQty++] = (Response) { host_now() + delay, key, requestId };
+}
+
+static void respond(const Response* response) {
+  DictionaryIterator* iter = NULL;
+  host_inboxBegin(&iter);
+  if (response->requestId != 0) { dict_write_uint16(iter, MESSAGE_KEY_REQUEST_ID, response->requestId); }
+
+  if (response->key == MESSAGE_KEY_GET_KIVA_INFO) {
+    dict_write_cstring(iter, MESSAGE_KEY_KIVA_COUNTRY_SET, "US|United States|KE|Kenya");
+  } else if (response->key == MESSAGE_KEY_LENDER_NAME) {
+    dict_write_cstring(iter, MESSAGE_KEY_LENDER_NAME, "Bob");
+    dict_write_cstring(iter, MESSAGE_KEY_LENDER_LOC, "Here");
+  } else if (response->key == MESSAGE_KEY_GET_LENDER_INFO) {
+    dict_write_cstring(iter, MESSAGE_KEY_LENDER_COUNTRY_SET, "KE|Kenya");
+  } else if (response->key == MESSAGE_KEY_GET_PREFERRED_LOANS) {
+    dict_write_cstring(iter, MESSAGE_KEY_LOAN_SET, "1|Ann|Cows|KE|50|100");
+  }
+  host_inboxDeliver();
+}
+
+static void deliverDueResponses(void) {
+  for (size_t i = 0; i < responseQty; i++) {
+    if ( (responses[i].due != 0) && (host_now() >= responses[i].due) ) {
+      responses[i].due = 0;
+      respond(&responses[i]);
+    }
+  }
+}
+
+
+// Acknowledges the outstanding dictionary and schedules answers to the
+// requests it carries.
+static void receiveFromWatch(uint32_t startedAt) {
+  DictionaryIterator iter;
+  host_lastSent(&iter);
+
+  uint16_t requestId = 0;
+  Tuple* tuple = dict_find(&iter, MESSAGE_KEY_REQUEST_ID);
+  if (tuple != NULL) { requestId = tuple->value->uint16; }
+
+  printf("%5u ms: watch sent", host_now() - startedAt);
+  int requestQty = 0;
+  for (tuple = dict_read_first(&iter); tuple != NULL; tuple = dict_read_next(&iter)) {
+    const char* name = host_keyName(tuple->key);
+    printf(" %s", name);
+    if (tuple->key != MESSAGE_KEY_REQUEST_ID) { requestQty++; }
+    if (protocol < 2) {
+      assert( (strcmp(name, "PROTOCOL_CAPS") != 0) && (strcmp(name, "INBOX_SIZE") != 0) &&
+              (strcmp(name, "CHUNK_SIZE") != 0) );
+    }
+    if (tuple->key == MESSAGE_KEY_GET_KIVA_INFO) {
+      respondLater(2500, tuple->key, requestId);
+    } else if (tuple->key == MESSAGE_KEY_GET_LENDER_INFO) {
+      respondLater(700, MESSAGE_KEY_LENDER_NAME, requestId);
+      respondLater(1500, tuple->key, requestId);
+    } else if (tuple->key == MESSAGE_KEY_GET_PREFERRED_LOANS) {
+      respondLater(1000, tuple->key, requestId);
+    }
+  }
+  printf("\n");
+  if (protocol < 2) { assert(requestQty == 1); }
+  host_ack();
+}
+
+
+int main(int argc, char** argv) {
+  if ( (argc > 1) && (strncmp(argv[1], "-protocol=", 10) == 0) ) { protocol = atoi(argv[1] + 10); }
+
+  persist_write_string(LENDER_ID_STR_SETTING, "bob");
+  comm_setHandlers((CommHandlers) { .updateViewClock = updateViewClock, .updateViewData = updateViewData });
+  comm_open();
+
+  uint32_t startedAt = host_now();
+  DictionaryIterator* iter = NULL;
+  host_inboxBegin(&iter);
+  dict_write_uint8(iter, MESSAGE_KEY_PEBKIT_READY, protocol);
+  uint32_t capsKey = host_keyByName("PROTOCOL_CAPS");
+  if ( (protocol >= 2) && (capsKey != 0) ) { dict_write_uint32(iter, capsKey, PHONE_CAPS); }
+  host_inboxDeliver();
+
+  uint32_t ackAt = 0;
+  while ( (host_now() - startedAt < TIME_LIMIT_MS) && (firstLoansAt == 0) ) {
+    if ( (host_outboxState() == HOST_OUTBOX_SENT) && (ackAt == 0) ) { ackAt = host_now() + ACK_DELAY_MS; }
+    if ( (ackAt != 0) && (host_now() >= ackAt) ) {
+      receiveFromWatch(startedAt);
+      ackAt = 0;
+    }
+    deliverDueResponses();
+    host_advance(TICK_MS);
+  }
+  assert(firstLoansAt != 0);
+
+  char* countryCodes = NULL;
+  KivaModel_getLenderCountryCodes(lastModel, true, &countryCodes);
+  printf("lender countries: %s\n", (countryCodes != NULL) ? countryCodes : "(none)");
+  free(countryCodes);
+  printf("time to first loan list: %u ms\n", firstLoansAt - startedAt);
+
+  comm_close();
+  return 0;
+}
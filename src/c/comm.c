@@ -8,63 +8,210 @@
 
 #include "comm.h"
 #include "data/KivaModel.h"
-#include "libs/data-processor.h"
+#include "libs/ChunkTracker.h"
+#include "libs/LatencyHistogram.h"
+#include "libs/RecordSchema.h"
+#include "libs/RetryPolicy.h"
 #include "libs/RingBuffer.h"
+#include "libs/SendScheduler.h"
+#include "libs/SessionDict.h"
+#include "libs/TransferSession.h"
+#include "libs/TypedRing.h"
+#include "libs/WorkQueue.h"
+
+
+// Dictionaries sent but not yet acknowledged by the phone. AppMessage
+// allows only one outbox in flight: app_message_outbox_begin() is busy
+// until the last dictionary is acknowledged.
+#define SEND_WINDOW 1
+// Requests packed into one dictionary, so they share a round trip.
+#define SEND_BATCH_MAX 4
+#define SEND_WINDOW_MSGS (SEND_WINDOW * SEND_BATCH_MAX)
+#define SEND_INTERACTIVE_QTY 4
+#define SEND_PREFETCH_QTY 6
+#define SEND_BACKGROUND_QTY 2
+// Every message that can be queued or in flight, plus one being enqueued.
+#define SEND_SLOT_QTY (SEND_INTERACTIVE_QTY + SEND_PREFETCH_QTY + SEND_BACKGROUND_QTY + SEND_WINDOW_MSGS + 1)
+
+TYPED_RING_DEFINE(BatchRing, uint8_t, SEND_WINDOW)
 
 
 static KivaModel* dataModel;
 static CommHandlers commHandlers;
-static RingBuffer* sendBuffer;
+static SendScheduler* sendScheduler;
+static RingBuffer* sendWindow;
+static WorkQueue* ingestQueue;
+static TransferSession* transferSession;
+static SessionDict* countryDict;  ///< country indices the phone assigned for this PebbleKit JS session
+static uint16_t startupSession;   ///< session held for the initial sync
+static bool startupHeld;
+static uint32_t openedMs;         ///< when comm_open() ran, for measuring startup
+static bool firstLoansLogged;
 static ClaySettings settings;
 static char** strSettings;
-static AppTimer* sendRetryTimer;
-static uint8_t sendRetryCount;
+static RetryPolicy* sendRetry;
+static uint8_t sendInFlight;      ///< messages at the front of sendWindow that were handed to AppMessage
+static BatchRing sendBatches;     ///< message count of each dictionary handed to AppMessage but not yet acknowledged, oldest first
+static uint16_t nextRequestId;    ///< REQUEST_ID of the next outbound dictionary; never 0
+static uint32_t inboxSize;        ///< AppMessage inbox size, advertised to the phone as INBOX_SIZE
+static uint32_t chunkSize;        ///< largest message the phone is asked to send (CHUNK_SIZE)
 static bool pebkitReady;
-
-const uint8_t MAX_SEND_RETRIES = 5;
-const uint8_t SEND_BUF_SIZE = 10;
+static bool phoneConnected;       ///< the Pebble app on the phone is reachable
+static uint8_t peerVersion;       ///< protocol version of PebbleKit JS; 0 until PEBKIT_READY
+static uint32_t peerCaps;         ///< ProtocolCaps that PebbleKit JS supports
+static bool refreshMissed;        ///< a periodic refresh fell due while disconnected
+
+const uint16_t OUTBOX_SIZE = 300;
+// Each dropped oversized message halves the chunk size, down to this.
+const uint16_t CHUNK_SIZE_MIN = 256;
+// Lower-priority messages are sent after being passed over this many times.
+const uint8_t SEND_AGING_LIMIT = 4;
+
+// Queue bounds per priority class. A user action replaces the oldest one
+// still waiting; periodic refreshes are simply refused when backed up.
+static const SendClassConfig SEND_CLASSES[MSG_PRIORITY_QTY] = {
+  [MSG_PRIORITY_INTERACTIVE] = { .capacity = SEND_INTERACTIVE_QTY, .overflow = SEND_OVERFLOW_EVICT_OLDEST },
+  [MSG_PRIORITY_PREFETCH]    = { .capacity = SEND_PREFETCH_QTY,    .overflow = SEND_OVERFLOW_EVICT_OLDEST },
+  [MSG_PRIORITY_BACKGROUND]  = { .capacity = SEND_BACKGROUND_QTY,  .overflow = SEND_OVERFLOW_REJECT }
+};
+
+// Send retries back off per priority class: the user is retried quickly,
+// periodic refreshes back off far. Six failures in a row pause sending.
+static const RetryClassConfig SEND_RETRY_CLASSES[MSG_PRIORITY_QTY] = {
+  [MSG_PRIORITY_INTERACTIVE] = { .baseMs = 500,  .maxMs = 4000,  .maxAttempts = 5 },
+  [MSG_PRIORITY_PREFETCH]    = { .baseMs = 1000, .maxMs = 8000,  .maxAttempts = 5 },
+  [MSG_PRIORITY_BACKGROUND]  = { .baseMs = 4000, .maxMs = 30000, .maxAttempts = 3 }
+};
+static const RetryLimits SEND_RETRY_LIMITS = { .breakerThreshold = 6, .breakerCooldownMs = 30000, .budget = 10 };
+
+// Preallocated messages, so that enqueueing does not touch the heap unless
+// a payload outgrows its slot.
+static Message sendSlots[SEND_SLOT_QTY];
 const uint32_t SETTINGS_STRUCT_KEY = 0x1000;
+// Undelivered messages saved at exit: their quantity, then one per key.
+const uint32_t SEND_QUEUE_PERSIST_KEY = 0x2000;
+const uint32_t SEND_QUEUE_MAX_AGE_S = 15 * 60;
+const uint16_t INGEST_RECORDS_PER_STEP = 8;
+const uint16_t INGEST_SLICE_MS = 25;
+const uint16_t INGEST_YIELD_MS = 15;
+const uint16_t CHUNK_RESEND_TIMEOUT_MS = 3000;
+const uint8_t MAX_CHUNK_RESENDS = 3;
+// A transfer session that receives nothing for this long gives the radio
+// back, even if its transfers are unfinished.
+const uint32_t TRANSFER_IDLE_TIMEOUT_MS = 10000;
+
+// A saved message is its key, creation time and priority, packed, followed
+// by the payload without its terminator.
+#define SAVED_MSG_HEADER_SIZE 9
+
+#define CHUNK_RESEND_MAX_SEQS 16
+#define CHUNK_RESEND_REQ_SIZE (11 + CHUNK_RESEND_MAX_SEQS * 6 + 1)
+
+// Protocol version announced in the PEBKIT_READY handshake. Version 1 is
+// the text protocol of scripts that predate the handshake; they send no
+// PROTOCOL_CAPS, and get none of the encodings below.
+#define PROTOCOL_VERSION 2
+
+// Optional wire encodings. Each side announces those it supports in
+// PROTOCOL_CAPS, and only those that both support are used. The bits must
+// match src/pkjs/index.js.
+typedef enum ProtocolCaps {
+  PROTO_CAP_BINARY_RECORDS = 1 << 0,   ///< record sets as packed binary records
+  PROTO_CAP_CHUNKED        = 1 << 1,   ///< record sets split into chunks, with CHUNK_RESEND
+  PROTO_CAP_DELTA_SYNC     = 1 << 2,   ///< record sets as deltas against a generation, with SYNC_RESET
+  PROTO_CAP_COUNTRY_DICT   = 1 << 3,   ///< countries named by session dictionary index
+  PROTO_CAP_NOT_MODIFIED   = 1 << 4,   ///< conditional requests, answered NOT_MODIFIED if unchanged
+  PROTO_CAP_BATCHED        = 1 << 5,   ///< several requests in one dictionary, each handled in turn
+} ProtocolCaps;
+
+#define PROTOCOL_CAPS (PROTO_CAP_BINARY_RECORDS | PROTO_CAP_CHUNKED | PROTO_CAP_DELTA_SYNC | PROTO_CAP_COUNTRY_DICT | \
+                       PROTO_CAP_NOT_MODIFIED | PROTO_CAP_BATCHED)
+
+// A request coded against countryDict is "<dictionary ID>:<coverage bitmap>",
+// both in hex; an uncoded one is a comma-separated list of country codes.
+#define COUNTRY_DICT_SEP ':'
+
+// A conditional request is its payload followed by "#<tag>.<tag>...": the
+// DATA_TAG, in hex, of each part of the answer whose data the model holds.
+#define DATA_TAG_SEP '#'
+// A DATA_TAG holds its DataPart in the top bits and a hash of the part's
+// content in the rest.
+#define DATA_TAG_PART_SHIFT 28
+
+
+static void requestLenderInfo(MsgPriority priority);
+static void requestPreferredLoans(MsgPriority priority);
+static bool acceptResponse(size_t route, uint16_t requestId);
 
 
 /////////////////////////////////////////////////////////////////////////////
+/// Takes a free message slot and copies the payload into it, so the
+/// caller's string need not outlive the call.
+/// @param[in]      msgKey  Message key
+/// @param[in]      payload  C-string to send
+/// @param[in]      priority  Scheduling class of the message
+/// @return  the message, or NULL if every slot is taken or an oversized
+///       payload cannot be allocated
 /////////////////////////////////////////////////////////////////////////////
-static Message* comm_msg_create(uint32_t msgKey, void* payload) {
-  Message* newMsg = malloc(sizeof(*newMsg));
-  if (newMsg == NULL) return NULL;
-  
+static Message* comm_msg_create(uint32_t msgKey, const char* payload, MsgPriority priority) {
+  Message* newMsg = NULL;
+  for (size_t idx=0; idx<ARRAY_LENGTH(sendSlots); idx++) {
+    if (!sendSlots[idx].inUse) { newMsg = &sendSlots[idx];  break; }
+  }
+  if (newMsg == NULL) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "No free message slot for message %d.", (int)msgKey);
+    return NULL;
+  }
+
+  if (payload == NULL) { payload = ""; }
+  size_t size = strlen(payload) + 1;
+  if (size <= sizeof(newMsg->inlinePayload)) {
+    newMsg->payload = newMsg->inlinePayload;
+  } else if ( (newMsg->payload = malloc(size)) == NULL) {
+    return NULL;
+  }
+  memcpy(newMsg->payload, payload, size);
+
   newMsg->key = msgKey;
-  newMsg->payload = payload;
+  newMsg->priority = priority;
+  newMsg->attempts = 0;
+  newMsg->queuedAt = time(NULL);
+  newMsg->inUse = true;
   return newMsg;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
+/// Returns a message's slot, freeing its payload if it outgrew the slot.
 /////////////////////////////////////////////////////////////////////////////
 static void comm_msg_destroy(Message* msg) {
-  if (msg != NULL) { free(msg); msg = NULL; }
+  if (msg == NULL) { return; }
+  if (msg->payload != msg->inlinePayload) { free(msg->payload); }
+  msg->payload = NULL;
+  msg->inUse = false;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Converts a tuple to a simple data type.
+/// Returns a millisecond clock suitable for measuring round trips.
 /////////////////////////////////////////////////////////////////////////////
-static bool unloadTupleStr(char** buffer, size_t bufsize, Tuple* tuple, const char* readable) {
-  if (*buffer == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "unloadTupleStr: Cannot write to null buffer!");
-    return false;
-  }
-  if (tuple != NULL) {
-    long ret = 0;
-    if ((ret = snprintf(*buffer, bufsize, "%s", tuple->value->cstring)) < 0) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "%s string was not written correctly. Ret=%ld", readable, ret);
-      return false;
-    } else if ((size_t)ret >= bufsize) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "%s string was truncated. %ld characters required.", readable, ret);
-    }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "unloadTupleStr %s: %s", readable, *buffer);
-    return true;
+static uint32_t nowMs() {
+  time_t secs = 0;
+  uint16_t ms = 0;
+  time_ms(&secs, &ms);
+  return (uint32_t)secs * 1000 + ms;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Notifies the View that the data model has been updated.
+/////////////////////////////////////////////////////////////////////////////
+static void notifyViewData() {
+  if (!commHandlers.updateViewData) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Attempted operation on NULL pointer.");
+  } else {
+    (*commHandlers.updateViewData)(dataModel);
   }
-  return false;
 }
 
 
@@ -82,301 +229,1101 @@ static bool unloadTupleLong(long int* buffer, Tuple* tuple, const char* readable
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Deserializes a MESSAGE_KEY_KIVA_COUNTRY_SET tuple.
+/// Record schemas for the record-set messages. Each record layout is
+/// declared once here and serves both the text and the binary encoding;
+/// unloadRecordSet() decodes every one of them with the same loop and hands
+/// each record to the emitter of its InboxRecordSet. Field order must match
+/// the encoders in src/pkjs/index.js.
 ///
+/// Country records also carry the index the phone gave the country in its
+/// session dictionary, which later messages use in place of the code.
+/////////////////////////////////////////////////////////////////////////////
+#define COUNTRY_FIELDS(X)                                                     \
+    X(CNTRY_ID,         RF_CC)                                                \
+    X(CNTRY_NAME,       RF_STR)                                               \
+    X(CNTRY_IDX,        RF_U8)
+RECORD_SCHEMA_FIELDS(COUNTRY, COUNTRY_FIELDS)
+
+#define LOAN_FIELDS(X)                                                        \
+    X(LOAN_ID,          RF_U32)                                               \
+    X(LOAN_NAME,        RF_STR)                                               \
+    X(LOAN_USE,         RF_STR)                                               \
+    X(LOAN_CNTRY,       RF_CC)                                                \
+    X(LOAN_FUNDED_AMT,  RF_U16)                                               \
+    X(LOAN_AMT,         RF_U16)
+RECORD_SCHEMA_FIELDS(LOAN, LOAN_FIELDS)
+
+// Removals in a delta carry only the key field of each record.
+#define COUNTRY_KEY_FIELDS(X)                                                 \
+    X(CNTRY_KEY_ID,     RF_CC)
+RECORD_SCHEMA_FIELDS(COUNTRY_KEY, COUNTRY_KEY_FIELDS)
+
+#define LOAN_KEY_FIELDS(X)                                                    \
+    X(LOAN_KEY_ID,      RF_U32)
+RECORD_SCHEMA_FIELDS(LOAN_KEY, LOAN_KEY_FIELDS)
+
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode emitKivaCountry(void* context, const RecordValue* values) {
+  if (peerCaps & PROTO_CAP_COUNTRY_DICT) { SessionDict_define(countryDict, values[CNTRY_IDX].u8, values[CNTRY_ID].cc); }
+  return KivaModel_addKivaCountry(dataModel, values[CNTRY_ID].cc, values[CNTRY_NAME].str);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode emitLenderCountry(void* context, const RecordValue* values) {
+  if (peerCaps & PROTO_CAP_COUNTRY_DICT) { SessionDict_define(countryDict, values[CNTRY_IDX].u8, values[CNTRY_ID].cc); }
+  return KivaModel_addLenderCountry(dataModel, values[CNTRY_ID].cc, values[CNTRY_NAME].str);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode emitPreferredLoan(void* context, const RecordValue* values) {
+  LoanInfo loanInfo = (LoanInfo) {
+    .id =          values[LOAN_ID].u32,
+    .name =        values[LOAN_NAME].str,
+    .use =         values[LOAN_USE].str,
+    .fundedAmt =   values[LOAN_FUNDED_AMT].u16,
+    .loanAmt =     values[LOAN_AMT].u16
+  };
+  memcpy(loanInfo.countryCode, values[LOAN_CNTRY].cc, sizeof(loanInfo.countryCode));
+  APP_LOG(APP_LOG_LEVEL_INFO, "[%ld] [%s] [%s] [%d] [%d] [%s]", loanInfo.id, loanInfo.name, loanInfo.countryCode,
+          loanInfo.fundedAmt, loanInfo.loanAmt, loanInfo.use);
+  return KivaModel_addPreferredLoanRef(dataModel, loanInfo);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode removeLenderCountry(void* context, const RecordValue* values) {
+  return KivaModel_removeLenderCountry(dataModel, values[CNTRY_KEY_ID].cc);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode removePreferredLoan(void* context, const RecordValue* values) {
+  return KivaModel_removePreferredLoan(dataModel, values[LOAN_KEY_ID].u32);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Starts a new generation of lender-supported countries.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode beginLenderCountryGeneration() {
+  return KivaModel_clearLenderCountries(dataModel);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Starts a new generation of preferred loans. The previous generation is
+/// dropped before any of the new one is stored so that only one copy of
+/// the loan payload is ever on the heap.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode beginPreferredLoanGeneration() {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+
+  if ( (mpaRet = KivaModel_clearPreferredLoans(dataModel)) != MPA_SUCCESS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Error clearing preferred loan list: %s", MagPebApp_getErrMsg(mpaRet));
+  }
+  return mpaRet;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Provides storage for one LOAN_SET chunk within the current generation;
+/// the records keep pointing into it.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode allocPreferredLoanBuf(size_t size, char** buf) {
+  return KivaModel_allocPrefLoanBuf(dataModel, size, buf);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Ends the ingest of a LOAN_SET chunk; the storage is freed once no loan
+/// borrows from it, so that deltas do not pile up until the next full set.
+/////////////////////////////////////////////////////////////////////////////
+static void releasePreferredLoanBuf(char* buf) {
+  KivaModel_releasePrefLoanBuf(dataModel, buf);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Follow-up once a KIVA_COUNTRY_SET has been ingested. Lender data no
+/// longer waits for it; the model keeps lender support across the update.
+/////////////////////////////////////////////////////////////////////////////
+static void kivaCountrySetDone() {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  int kivaCountryQty = 0;
+  if ( (mpaRet = KivaModel_getKivaCountryQty(dataModel, &kivaCountryQty)) != MPA_SUCCESS) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Error getting Kiva country quantity from data model: %s", MagPebApp_getErrMsg(mpaRet));
+  }
+  APP_LOG(APP_LOG_LEVEL_INFO, "Kiva active country total: %d", kivaCountryQty);
+  // The bulk of the initial sync is in.
+  if (startupHeld) { TransferSession_end(transferSession, startupSession);  startupHeld = false; }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Follow-up once a LENDER_COUNTRY_SET has been ingested.
+/////////////////////////////////////////////////////////////////////////////
+static void lenderCountrySetDone() {
+  requestPreferredLoans(MSG_PRIORITY_PREFETCH);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Follow-up once a LOAN_SET has been ingested.
+/////////////////////////////////////////////////////////////////////////////
+static void preferredLoanSetDone() {
+  if (!firstLoansLogged) {
+    firstLoansLogged = true;
+    APP_LOG(APP_LOG_LEVEL_INFO, "Time to first loan list: %lu ms", (unsigned long)(nowMs() - openedMs));
+  }
+  HEAP_LOG("after preferred loan ingest");
+}
+
+
+// Parts of the phone's answers that it tags with a DATA_TAG: each request
+// that can be made conditional is answered with one or more of them. The
+// numbers must match src/pkjs/index.js.
+typedef enum DataPart {
+  DATA_PART_NONE = 0,
+  DATA_PART_LENDER_PROFILE,     ///< lender name, location and loan quantity
+  DATA_PART_LENDER_LOANS,       ///< lender's countries
+  DATA_PART_LOAN_SET,           ///< preferred loans
+
+  DATA_PART_QTY
+} DataPart;
+
+static uint32_t dataTags[DATA_PART_QTY];   ///< DATA_TAG of the data the model holds, by part; 0 if none
+static uint32_t dataTagResets;             ///< times forgetDataTags() has run, so a handler's reset is not undone
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Forgets every DATA_TAG, so that the next requests are answered in full.
+/// Used whenever the model may no longer hold what a tag describes.
+/////////////////////////////////////////////////////////////////////////////
+static void forgetDataTags() {
+  memset(dataTags, 0, sizeof(dataTags));
+  dataTagResets++;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Remembers the DATA_TAG of an answer that the model now holds.
+/////////////////////////////////////////////////////////////////////////////
+static void keepDataTag(uint32_t tag) {
+  uint32_t part = tag >> DATA_TAG_PART_SHIFT;
+  if ( (part == DATA_PART_NONE) || (part >= DATA_PART_QTY) ) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Ignoring data tag %08lx of unknown part.", (unsigned long)tag);
+    return;
+  }
+  dataTags[part] = tag;
+}
+
+
+// Reception state of the latest (possibly chunked) transfer of a record set.
+typedef struct InboxTransfer {
+  ChunkTracker chunks;
+  uint32_t     syncGen;         ///< generation the model holds; 0 if unknown, which forces a full resync
+  uint32_t     pendingGen;      ///< generation the model will hold once this transfer is finished
+  uint16_t     pendingJobs;     ///< ingest jobs enqueued but not yet finished
+  bool         rejected : 1;    ///< delta against a generation the model does not hold; chunks are dropped
+  bool         abandoned : 1;   ///< missing chunks will not be requested again
+  bool         finished : 1;    ///< the record set's follow-up has run
+  uint8_t      resendQty;       ///< CHUNK_RESEND requests made for this transfer
+  AppTimer*    resendTimer;
+  uint16_t     session;         ///< TransferSession held while a multi-chunk transfer is unfinished
+  bool         inSession;
+} InboxTransfer;
+
+static InboxTransfer kivaCountryTransfer;
+static InboxTransfer lenderCountryTransfer;
+static InboxTransfer preferredLoanTransfer;
+
+
+// A record-set message: its schema, where its payload copies live, and what
+// happens once all of its records are in the model.
+//
+// A transfer either carries the full set (replacing the previous generation
+// if beginGeneration is set) or, if it names the generation it is based on,
+// a delta: changed and added records in the usual payload, plus the keys of
+// removed records in SYNC_REMOVE_SET. A delta against any generation other
+// than the one the model holds is dropped and a SYNC_RESET asks the phone
+// for the full set.
+typedef struct InboxRecordSet {
+  RecordSchema      schema;
+  RecordSchema      legacySchema;                  ///< records of a phone without PROTO_CAP_COUNTRY_DICT; numFields is 0 if the same
+  RecordSchema      removeSchema;                  ///< key-only records removed by a delta; emit is NULL if deltas are unsupported
+  const char*       syncName;                      ///< message key name sent in SYNC_RESET
+  MagPebApp_ErrCode (*beginGeneration)(void);      ///< replaces the set when a full transfer starts; NULL to merge
+  MagPebApp_ErrCode (*allocBuf)(size_t, char**);   ///< model-owned storage for a chunk; NULL for a temporary copy
+  void              (*releaseBuf)(char*);          ///< hands allocBuf storage back once its chunk is ingested
+  void              (*onDone)(void);               ///< follow-up after the whole transfer is ingested; may be NULL
+  InboxTransfer*    transfer;
+} InboxRecordSet;
+
+static const InboxRecordSet kivaCountrySet = {
+  .schema = { "Kiva-Served Countries", COUNTRY_NUM_FIELDS, COUNTRY_fieldTypes, emitKivaCountry },
+  .legacySchema = { "Kiva-Served Countries", CNTRY_IDX, COUNTRY_fieldTypes, emitKivaCountry },
+  .removeSchema = { "Kiva-Served Country Removals", COUNTRY_KEY_NUM_FIELDS, COUNTRY_KEY_fieldTypes, NULL },
+  .syncName = "KIVA_COUNTRY_SET",
+  .beginGeneration = NULL,
+  .allocBuf = NULL,
+  .releaseBuf = NULL,
+  .onDone = kivaCountrySetDone,
+  .transfer = &kivaCountryTransfer
+};
+
+static const InboxRecordSet lenderCountrySet = {
+  .schema = { "Lender-Supported Countries", COUNTRY_NUM_FIELDS, COUNTRY_fieldTypes, emitLenderCountry },
+  .legacySchema = { "Lender-Supported Countries", CNTRY_IDX, COUNTRY_fieldTypes, emitLenderCountry },
+  .removeSchema = { "Lender-Supported Country Removals", COUNTRY_KEY_NUM_FIELDS, COUNTRY_KEY_fieldTypes, removeLenderCountry },
+  .syncName = "LENDER_COUNTRY_SET",
+  .beginGeneration = beginLenderCountryGeneration,
+  .allocBuf = NULL,
+  .releaseBuf = NULL,
+  .onDone = lenderCountrySetDone,
+  .transfer = &lenderCountryTransfer
+};
+
+static const InboxRecordSet preferredLoanSet = {
+  .schema = { "Preferred Loans", LOAN_NUM_FIELDS, LOAN_fieldTypes, emitPreferredLoan },
+  .legacySchema = { "Preferred Loans", 0, NULL, NULL },
+  .removeSchema = { "Preferred Loan Removals", LOAN_KEY_NUM_FIELDS, LOAN_KEY_fieldTypes, removePreferredLoan },
+  .syncName = "LOAN_SET",
+  .beginGeneration = beginPreferredLoanGeneration,
+  .allocBuf = allocPreferredLoanBuf,
+  .releaseBuf = releasePreferredLoanBuf,
+  .onDone = preferredLoanSetDone,
+  .transfer = &preferredLoanTransfer
+};
+
+static const InboxRecordSet* const inboxRecordSets[] = { &kivaCountrySet, &lenderCountrySet, &preferredLoanSet };
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the schema that the phone's records follow, which depends on
+/// the capabilities negotiated in the handshake.
+/////////////////////////////////////////////////////////////////////////////
+static const RecordSchema* recordSchemaOf(const InboxRecordSet* recordSet) {
+  if ( !(peerCaps & PROTO_CAP_COUNTRY_DICT) && (recordSet->legacySchema.numFields != 0) ) { return &recordSet->legacySchema; }
+  return &recordSet->schema;
+}
+
+
+// Sequencing and sync information that accompanies a record-set chunk.
+typedef struct TransferHeader {
+  uint32_t transferId;      ///< 0 for an unchunked message
+  uint16_t seq;
+  uint16_t qty;
+  uint32_t syncGen;         ///< generation the model holds after this transfer; 0 if untracked
+  uint32_t baseGen;         ///< generation a delta applies to; 0 for a full set
+  Tuple*   removeSet;       ///< keys of records removed by a delta; may be NULL
+  uint16_t requestId;       ///< REQUEST_ID of the request being answered; 0 if unsolicited
+  uint16_t dictId;          ///< session dictionary that indices in the message refer to; 0 if none
+  uint32_t protoCaps;       ///< PROTOCOL_CAPS accompanying PEBKIT_READY; 0 if none
+  uint32_t dataTag;         ///< DATA_TAG of the answer's content; 0 if none
+} TransferHeader;
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// TransferReport: logs the throughput of a transfer session, and how long
+/// the radio spent in the reduced sniff interval for it.
+/////////////////////////////////////////////////////////////////////////////
+static void reportTransferSession(const TransferStats* stats, void* context) {
+  uint32_t rate = (stats->durationMs > 0) ? (uint32_t)((uint64_t)stats->bytes * 1000 / stats->durationMs) : 0;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Transfer session: %lu bytes in %u messages over %lu ms (%lu B/s)%s.",
+          (unsigned long)stats->bytes, stats->messages, (unsigned long)stats->durationMs, (unsigned long)rate,
+          stats->timedOut ? ", timed out" : "");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Holds the transfer session open for a multi-chunk transfer.
+/////////////////////////////////////////////////////////////////////////////
+static void holdTransferSession(InboxTransfer* transfer) {
+  if (transfer->inSession) { return; }
+  transfer->inSession = (TransferSession_begin(transferSession, &transfer->session) == MPA_SUCCESS);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Releases a transfer's hold on the transfer session, if it has one.
+/////////////////////////////////////////////////////////////////////////////
+static void releaseTransferSession(InboxTransfer* transfer) {
+  if (!transfer->inSession) { return; }
+  TransferSession_end(transferSession, transfer->session);
+  transfer->inSession = false;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Reads a tuple into the transfer header if it belongs there.
+/// @return  true if the tuple is part of the header
+/////////////////////////////////////////////////////////////////////////////
+static bool readHeaderTuple(TransferHeader* header, Tuple* tuple) {
+  if (tuple->key == MESSAGE_KEY_TRANSFER_ID) { header->transferId = tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_CHUNK_SEQ) { header->seq = (uint16_t)tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_CHUNK_QTY) { header->qty = (uint16_t)tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_SYNC_GEN) { header->syncGen = tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_SYNC_BASE_GEN) { header->baseGen = tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_SYNC_REMOVE_SET) { header->removeSet = tuple; }
+  else if (tuple->key == MESSAGE_KEY_REQUEST_ID) { header->requestId = (uint16_t)tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_DICT_ID) { header->dictId = (uint16_t)tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_PROTOCOL_CAPS) { header->protoCaps = tuple->value->uint32; }
+  else if (tuple->key == MESSAGE_KEY_DATA_TAG) { header->dataTag = tuple->value->uint32; }
+  else { return false; }
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Applies the removals of a delta. They are few, so they are decoded
+/// straight from the tuple rather than from the ingest queue.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode applyRemovals(const InboxRecordSet* recordSet, Tuple* tuple) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  RecordDecoder decoder;
+  bool done = false;
+  size_t len = 0;
+  char* buf = NULL;
+
+  if (tuple->type == TUPLE_BYTE_ARRAY) {
+    len = tuple->length;
+  } else if (tuple->type == TUPLE_CSTRING) {
+    len = strlen(tuple->value->cstring);
+  } else {
+    return MPA_INVALID_INPUT_ERR;
+  }
+  if ( (buf = malloc(len + 1)) == NULL) { return MPA_OUT_OF_MEMORY_ERR; }
+  memcpy(buf, tuple->value->data, len);
+  buf[len] = '\0';
+
+  if (tuple->type == TUPLE_BYTE_ARRAY) {
+    mpaRet = RecordDecoder_initBinary(&decoder, &recordSet->removeSchema, (uint8_t*) buf, len, NULL);
+  } else {
+    mpaRet = RecordDecoder_init(&decoder, &recordSet->removeSchema, buf, len, '|', NULL);
+  }
+  while ( (mpaRet == MPA_SUCCESS) && !done ) {
+    mpaRet = RecordDecoder_step(&decoder, UINT16_MAX, &done);
+  }
+  APP_LOG(APP_LOG_LEVEL_INFO, "Removed %d %s records.", decoder.recordQty, recordSet->schema.readable);
+
+  free(buf);  buf = NULL;
+  return mpaRet;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Runs the record set's follow-up once its transfer has been fully
+/// received (or given up on) and every chunk has been ingested.
+/////////////////////////////////////////////////////////////////////////////
+static void finishTransferIfDone(const InboxRecordSet* recordSet) {
+  InboxTransfer* transfer = recordSet->transfer;
+
+  if (transfer->finished || (transfer->pendingJobs != 0)) { return; }
+  if (!ChunkTracker_complete(&transfer->chunks) && !transfer->abandoned) { return; }
+
+  transfer->finished = true;
+  transfer->syncGen = transfer->abandoned ? 0 : transfer->pendingGen;
+  if (transfer->abandoned) { forgetDataTags(); }
+  if (transfer->resendTimer != NULL) { app_timer_cancel(transfer->resendTimer);  transfer->resendTimer = NULL; }
+  releaseTransferSession(transfer);
+  if (recordSet->onDone != NULL) { (*recordSet->onDone)(); }
+  notifyViewData();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Timer callback: asks the phone to send the chunks of the current
+/// transfer that have not arrived, giving up after MAX_CHUNK_RESENDS tries.
+/////////////////////////////////////////////////////////////////////////////
+static void requestMissingChunks(void* data) {
+  const InboxRecordSet* recordSet = (const InboxRecordSet*) data;
+  InboxTransfer* transfer = recordSet->transfer;
+  transfer->resendTimer = NULL;
+
+  if (ChunkTracker_complete(&transfer->chunks) || transfer->finished) { return; }
+
+  if (transfer->resendQty >= MAX_CHUNK_RESENDS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Giving up on %d missing %s chunks.",
+            transfer->chunks.chunkQty - transfer->chunks.receivedQty, recordSet->schema.readable);
+    transfer->abandoned = true;
+    finishTransferIfDone(recordSet);
+    return;
+  }
+
+  // Payload: "<transfer ID>|<seq>|<seq>..." with as many sequence numbers as fit.
+  uint16_t missing[CHUNK_RESEND_MAX_SEQS];
+  uint16_t missingQty = 0;
+  ChunkTracker_getMissing(&transfer->chunks, missing, CHUNK_RESEND_MAX_SEQS, &missingQty);
+
+  char resendReq[CHUNK_RESEND_REQ_SIZE];
+  int len = snprintf(resendReq, sizeof(resendReq), "%lu", (unsigned long)transfer->chunks.transferId);
+  for (uint16_t idx = 0; idx < missingQty; idx++) {
+    len += snprintf(resendReq + len, sizeof(resendReq) - len, "|%u", missing[idx]);
+  }
+
+  transfer->resendQty++;
+  APP_LOG(APP_LOG_LEVEL_WARNING, "Requesting %d missing %s chunks: %s", missingQty, recordSet->schema.readable, resendReq);
+  comm_enqMsg(comm_msg_create(MESSAGE_KEY_CHUNK_RESEND, resendReq, MSG_PRIORITY_INTERACTIVE));
+  transfer->resendTimer = app_timer_register(CHUNK_RESEND_TIMEOUT_MS, requestMissingChunks, data);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Starts receiving a new transfer of a record set, superseding whatever
+/// remains of the previous one. A delta that does not apply to the
+/// generation the model holds is marked rejected, and the phone is asked
+/// for the full set instead. A multi-chunk transfer holds the transfer
+/// session open until it is finished.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode beginTransfer(const InboxRecordSet* recordSet, const TransferHeader* header) {
+  InboxTransfer* transfer = recordSet->transfer;
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  bool delta = (header->baseGen != 0);
+
+  if (transfer->resendTimer != NULL) { app_timer_cancel(transfer->resendTimer);  transfer->resendTimer = NULL; }
+  releaseTransferSession(transfer);
+  transfer->rejected = false;
+  transfer->abandoned = false;
+  transfer->finished = false;
+  transfer->resendQty = 0;
+  transfer->pendingGen = header->syncGen;
+
+  if ( delta && ((recordSet->removeSchema.emit == NULL) || (header->baseGen != transfer->syncGen)) ) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "%s delta is based on generation %ld, but the model holds %ld. Requesting full set.",
+            recordSet->schema.readable, header->baseGen, transfer->syncGen);
+    transfer->rejected = true;
+    transfer->finished = true;
+    forgetDataTags();
+    comm_enqMsg(comm_msg_create(MESSAGE_KEY_SYNC_RESET, recordSet->syncName, MSG_PRIORITY_INTERACTIVE));
+  } else if (!delta && (recordSet->beginGeneration != NULL)) {
+    // Unfinished ingest of the previous generation may point into buffers
+    // that are about to be released.
+    WorkQueue_cancel(ingestQueue, recordSet);
+    if ( (mpaRet = (*recordSet->beginGeneration)()) != MPA_SUCCESS) { return mpaRet; }
+  }
+
+  if (!transfer->rejected && (header->qty > 1)) { holdTransferSession(transfer); }
+  return ChunkTracker_begin(&transfer->chunks, header->transferId, header->qty);
+}
+
+
+// State of one record-set chunk being ingested in time slices.
+typedef struct IngestJob {
+  const InboxRecordSet* recordSet;
+  RecordDecoder         decoder;
+  char*                 tmpBuf;    ///< payload copy to free when done; NULL if the model owns it
+  char*                 modelBuf;  ///< model-owned payload to release when done; NULL if tmpBuf is used
+} IngestJob;
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// WorkQueue step: ingests the next few records of a record set.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode ingestJob_step(void* context, bool* done) {
+  IngestJob* job = (IngestJob*) context;
+  return RecordDecoder_step(&job->decoder, INGEST_RECORDS_PER_STEP, done);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// WorkQueue completion: refreshes the View so that each chunk shows up as
+/// soon as it is in the model, runs the record set's follow-up after the
+/// last one, and frees the job.
+/////////////////////////////////////////////////////////////////////////////
+static void ingestJob_done(void* context, MagPebApp_ErrCode result, bool cancelled) {
+  IngestJob* job = (IngestJob*) context;
+  const InboxRecordSet* recordSet = job->recordSet;
+
+  if (cancelled) {
+    APP_LOG(APP_LOG_LEVEL_INFO, "Cancelled %s ingest after %d records.", recordSet->schema.readable, job->decoder.recordQty);
+  } else {
+    if (result != MPA_SUCCESS) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Error retrieving %s: %s", recordSet->schema.readable, MagPebApp_getErrMsg(result));
+      // The model missed part of what the tag describes.
+      forgetDataTags();
+    }
+    APP_LOG(APP_LOG_LEVEL_INFO, "Unloaded %d %s records.", job->decoder.recordQty, recordSet->schema.readable);
+  }
+
+  if (job->tmpBuf != NULL) { free(job->tmpBuf);  job->tmpBuf = NULL; }
+  if (job->modelBuf != NULL) { (*recordSet->releaseBuf)(job->modelBuf);  job->modelBuf = NULL; }
+  free(job);  job = NULL;
+
+  if (recordSet->transfer->pendingJobs > 0) { recordSet->transfer->pendingJobs--; }
+  if (!cancelled) {
+    notifyViewData();
+    finishTransferIfDone(recordSet);
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Deserializes a record-set tuple (such as MESSAGE_KEY_KIVA_COUNTRY_SET,
+/// MESSAGE_KEY_LENDER_COUNTRY_SET or MESSAGE_KEY_LOAN_SET). A byte-array
+/// tuple carries binary records; a cstring tuple carries "|"-delimited
+/// text records.
+///
+/// Large record sets arrive as a sequence of chunks, each holding whole
+/// records. Every chunk is ingested as soon as it arrives, in whatever
+/// order; duplicates are ignored, and chunks that are still missing after
+/// CHUNK_RESEND_TIMEOUT_MS are requested again. The payload is copied
+/// exactly once: into model-owned storage if the record set provides it,
+/// otherwise into a temporary buffer that is freed once every record has
+/// been emitted. The records themselves are decoded a few at a time from
+/// ingestQueue so that a large payload does not stall the UI.
+///
+/// @param[in]      recordSet  Describes the message's records
 /// @param[in]      tuple  This tuple must be non-null and its key must
-///       match MESSAGE_KEY_KIVA_COUNTRY_SET.
+///       match the message described by recordSet.
+/// @param[in]      header  Sequencing information of the message
 ///
 /// @return  MPA_SUCCESS on success
-///          MPA_NULL_POINTER_ERR if parameters tuple or ... is
+///          MPA_NULL_POINTER_ERR if parameters tuple or recordSet is
 ///            NULL upon entry.
 ///          MPA_OUT_OF_MEMORY_ERR if a memory allocation fails
+///          MPA_INVALID_INPUT_ERR if the tuple is neither text nor binary,
+///            or the chunk header is inconsistent
 ///
 /////////////////////////////////////////////////////////////////////////////
-static MagPebApp_ErrCode unloadKivaCountrySet(Tuple* tuple) {
+static MagPebApp_ErrCode unloadRecordSet(const InboxRecordSet* recordSet, Tuple* tuple, const TransferHeader* header) {
+  MPA_RETURN_IF_NULL(recordSet);
   MPA_RETURN_IF_NULL(tuple);
+  MPA_RETURN_IF_NULL(ingestQueue);
+
+  InboxTransfer* transfer = recordSet->transfer;
+  bool binary = (tuple->type == TUPLE_BYTE_ARRAY);
+  if (!binary && (tuple->type != TUPLE_CSTRING)) { return MPA_INVALID_INPUT_ERR; }
+
+  size_t len = binary ? tuple->length : strlen(tuple->value->cstring);
+  char* buf = NULL;
+  IngestJob* job = NULL;
+  bool isNew = false;
+  MagPebApp_ErrCode myret = MPA_SUCCESS;
 
-  const char* readable = "Kiva-Served Countries";
-  char* countrySetBuf = NULL;
-  ProcessingState* state = NULL;
-  uint16_t num_strings = 0;
-  uint16_t idx = 0;
-  char** strings = NULL;
-  MagPebApp_ErrCode mpaRet = MPA_SUCCESS, myret = MPA_OUT_OF_MEMORY_ERR;
+  if ( (header->transferId == 0) || (header->transferId != transfer->chunks.transferId) ) {
+    if ( (myret = beginTransfer(recordSet, header)) != MPA_SUCCESS) { return myret; }
+  }
+  if ( (myret = ChunkTracker_mark(&transfer->chunks, header->seq, &isNew)) != MPA_SUCCESS) { return myret; }
+  if (transfer->rejected) { return MPA_SUCCESS; }
+  if (!isNew) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Ignoring duplicate %s chunk %d.", recordSet->schema.readable, header->seq);
+    return MPA_SUCCESS;
+  }
+
+  if ( (header->baseGen != 0) && (header->removeSet != NULL) ) {
+    if ( (myret = applyRemovals(recordSet, header->removeSet)) != MPA_SUCCESS) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Error removing %s records: %s", recordSet->schema.readable, MagPebApp_getErrMsg(myret));
+    }
+  }
 
-  size_t bufsize = strlen(tuple->value->cstring)+1;
-  if (bufsize == 1) { myret = MPA_INVALID_INPUT_ERR; goto freemem; }
-  if ( (countrySetBuf = malloc(bufsize)) == NULL) { goto freemem; }
+  myret = MPA_OUT_OF_MEMORY_ERR;
+  if ( (job = malloc(sizeof(*job))) == NULL) { goto freemem; }
+  job->recordSet = recordSet;
+  job->tmpBuf = NULL;
+  job->modelBuf = NULL;
 
-  if (!unloadTupleStr(&countrySetBuf, bufsize, tuple, readable)) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Error in unloadTupleStr.");
+  if (recordSet->allocBuf == NULL) {
+    if ( (buf = malloc(len + 1)) == NULL) { goto freemem; }
+    job->tmpBuf = buf;
+  } else if ( (myret = (*recordSet->allocBuf)(len + 1, &buf)) != MPA_SUCCESS) {
     goto freemem;
+  } else {
+    job->modelBuf = buf;
   }
+  memcpy(buf, tuple->value->data, len);
+  buf[len] = '\0';
 
-  if ( (state = data_processor_create(countrySetBuf, '|')) == NULL) { goto freemem; }
-  num_strings = data_processor_count(state);
-  if (num_strings == 0) { myret = MPA_INVALID_INPUT_ERR; goto freemem; }
-  if ( (strings = calloc(num_strings, sizeof(*strings))) == NULL) { goto freemem; }
+  if (binary) {
+    myret = RecordDecoder_initBinary(&job->decoder, recordSchemaOf(recordSet), (uint8_t*) buf, len, NULL);
+  } else {
+    myret = RecordDecoder_init(&job->decoder, recordSchemaOf(recordSet), buf, len, '|', NULL);
+  }
+  if (myret != MPA_SUCCESS) { goto freemem; }
+  if ( (myret = WorkQueue_enqueue(ingestQueue, ingestJob_step, ingestJob_done, job, recordSet)) != MPA_SUCCESS) { goto freemem; }
+  transfer->pendingJobs++;
 
-  for (idx = 0; idx < num_strings; idx += 2) {
-    strings[idx] = data_processor_get_string(state);
-    if (strings[idx] == NULL) { goto freemem; }
+  if (transfer->resendTimer != NULL) { app_timer_cancel(transfer->resendTimer);  transfer->resendTimer = NULL; }
+  if (!ChunkTracker_complete(&transfer->chunks)) {
+    transfer->resendTimer = app_timer_register(CHUNK_RESEND_TIMEOUT_MS, requestMissingChunks, (void*) recordSet);
+  }
+  return MPA_SUCCESS;
 
-    strings[idx+1] = data_processor_get_string(state);
-    if (strings[idx+1] == NULL) {goto freemem; }
+freemem:
+  if (job != NULL) {
+    if (job->tmpBuf != NULL) { free(job->tmpBuf);  job->tmpBuf = NULL; }
+    if (job->modelBuf != NULL) { (*recordSet->releaseBuf)(job->modelBuf);  job->modelBuf = NULL; }
+    free(job);  job = NULL;
+  }
+  return myret;
+}
 
-    if ( (mpaRet = KivaModel_addKivaCountry(dataModel, strings[idx], strings[idx+1])) != MPA_SUCCESS) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Error adding Kiva country to data model: %s", MagPebApp_getErrMsg(mpaRet));
-    }
 
-    if (strings[idx+1] != NULL) { free(strings[idx+1]);  strings[idx+1] = NULL; }
-    if (strings[idx] != NULL) { free(strings[idx]);  strings[idx] = NULL; }
+/////////////////////////////////////////////////////////////////////////////
+/// Inbox handlers, one per message key. Each is handed its tuple once the
+/// whole dictionary has been read, along with the transfer header.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode handlePebkitReady(Tuple* tuple, const TransferHeader* header) {
+  // PEBKIT_READY carries the script's protocol version. Older scripts send
+  // 1 and no capabilities; they are spoken to in the text protocol.
+  long int version = 0;
+  unloadTupleLong(&version, tuple, "Protocol Version");
+  peerVersion = (version < 1) ? 1 : ((version > UINT8_MAX) ? UINT8_MAX : (uint8_t)version);
+  peerCaps = (peerVersion >= 2) ? (header->protoCaps & PROTOCOL_CAPS) : 0;
+  APP_LOG(APP_LOG_LEVEL_INFO, "PebbleKit JS sent ready message! Protocol %d, capabilities %lx.", peerVersion,
+          (unsigned long)peerCaps);
+
+  // The initial sync runs with the radio in its faster mode.
+  if (startupHeld) { TransferSession_end(transferSession, startupSession); }
+  startupHeld = (TransferSession_begin(transferSession, &startupSession) == MPA_SUCCESS);
+
+  // A new PebbleKit JS session numbers its countries afresh.
+  SessionDict_reset(countryDict, 0);
+
+  // The handshake and every startup request that does not depend on a
+  // response are queued before sending starts, so that they go out
+  // together with whatever was buffered (such as the lender's requests).
+  // The phone sizes its messages to fit the inbox, and picks its
+  // encodings from the capabilities the watch announces first. Older
+  // scripts know none of the handshake keys, and are sent only requests.
+  if (peerVersion >= 2) {
+    char size[12];
+    char caps[24];
+    snprintf(caps, sizeof(caps), "%d:%lu", PROTOCOL_VERSION, (unsigned long)PROTOCOL_CAPS);
+    comm_enqMsg(comm_msg_create(MESSAGE_KEY_PROTOCOL_CAPS, caps, MSG_PRIORITY_INTERACTIVE));
+    snprintf(size, sizeof(size), "%lu", (unsigned long)inboxSize);
+    comm_enqMsg(comm_msg_create(MESSAGE_KEY_INBOX_SIZE, size, MSG_PRIORITY_INTERACTIVE));
+    if (chunkSize < inboxSize) {
+      snprintf(size, sizeof(size), "%lu", (unsigned long)chunkSize);
+      comm_enqMsg(comm_msg_create(MESSAGE_KEY_CHUNK_SIZE, size, MSG_PRIORITY_INTERACTIVE));
+    }
   }
+  comm_enqMsg(comm_msg_create(MESSAGE_KEY_GET_KIVA_INFO, "", MSG_PRIORITY_PREFETCH));
 
-  if (strings != NULL) { free(strings);  strings = NULL; }
-  if (state != NULL) { free(state);  state = NULL; }
-  if (countrySetBuf != NULL) { free(countrySetBuf); countrySetBuf = NULL; }
+  // PebbleKit JS is ready! Safe to send messages
+  pebkitReady = true;
+  comm_sendBufMsg();
+  return MPA_SUCCESS;
+}
 
-  int kivaCountryQty = 0;
-  if ( (mpaRet = KivaModel_getKivaCountryQty(dataModel, &kivaCountryQty)) != MPA_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error getting Kiva country quantity from data model: %s", MagPebApp_getErrMsg(mpaRet));
+
+/////////////////////////////////////////////////////////////////////////////
+/// Country sets define entries of the phone's session dictionary. One from
+/// a session other than the dictionary's starts the dictionary over.
+/////////////////////////////////////////////////////////////////////////////
+static void adoptCountryDict(uint16_t dictId) {
+  if ( (dictId == 0) || (dictId == SessionDict_id(countryDict)) ) { return; }
+  APP_LOG(APP_LOG_LEVEL_INFO, "Starting country dictionary %u.", dictId);
+  SessionDict_reset(countryDict, dictId);
+}
+
+
+static MagPebApp_ErrCode handleKivaCountrySet(Tuple* tuple, const TransferHeader* header) {
+  adoptCountryDict(header->dictId);
+  return unloadRecordSet(&kivaCountrySet, tuple, header);
+}
+
+
+static MagPebApp_ErrCode handleLenderId(Tuple* tuple, const TransferHeader* header) {
+  // The model copies the string, so it can be read straight from the tuple.
+  APP_LOG(APP_LOG_LEVEL_INFO, "Lender Id = %s", tuple->value->cstring);
+  MagPebApp_ErrCode mpaRet = KivaModel_setLenderId(dataModel, tuple->value->cstring);
+  // The lender's country set is not the one a delta would be based on, and
+  // no answer about the previous lender describes this one.
+  lenderCountryTransfer.syncGen = 0;
+  forgetDataTags();
+  comm_savePersistent();
+  requestLenderInfo(MSG_PRIORITY_PREFETCH);
+  return mpaRet;
+}
+
+
+static MagPebApp_ErrCode handleLenderName(Tuple* tuple, const TransferHeader* header) {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Lender Name = %s", tuple->value->cstring);
+  return KivaModel_setLenderName(dataModel, tuple->value->cstring);
+}
+
+
+static MagPebApp_ErrCode handleLenderLoc(Tuple* tuple, const TransferHeader* header) {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Lender Location = %s", tuple->value->cstring);
+  return KivaModel_setLenderLoc(dataModel, tuple->value->cstring);
+}
+
+
+static MagPebApp_ErrCode handleLenderLoanQty(Tuple* tuple, const TransferHeader* header) {
+  long int lenderLoanQty = 0;
+  unloadTupleLong(&lenderLoanQty, tuple, "Lender Loan Quantity");
+  return KivaModel_setLenderLoanQty(dataModel, (int)lenderLoanQty);
+}
+
+
+static MagPebApp_ErrCode handleLenderCountrySet(Tuple* tuple, const TransferHeader* header) {
+  adoptCountryDict(header->dictId);
+  return unloadRecordSet(&lenderCountrySet, tuple, header);
+}
+
+
+static MagPebApp_ErrCode handlePreferredLoanSet(Tuple* tuple, const TransferHeader* header) {
+  return unloadRecordSet(&preferredLoanSet, tuple, header);
+}
+
+
+// A LENDER_COUNTRY_MAP waiting in ingestQueue behind the country chunks
+// that arrived before it, which may define the indices it uses.
+typedef struct CountryMapJob {
+  uint16_t dictId;
+  uint16_t len;
+  uint8_t  bitmap[];      ///< bit (idx % 8) of byte (idx / 8) is set for each country
+} CountryMapJob;
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// WorkQueue step: replaces the lender's countries with those set in the
+/// map. A map that does not resolve against countryDict is answered with a
+/// SYNC_RESET, so that the phone sends the records instead.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode countryMapJob_step(void* context, bool* done) {
+  CountryMapJob* job = (CountryMapJob*) context;
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  size_t idxQty = (size_t)job->len * 8;
+  if (idxQty > SESSION_DICT_MAX_ENTRIES) { idxQty = SESSION_DICT_MAX_ENTRIES; }
+  const char* code = NULL;
+  *done = true;
+
+  bool resolved = (job->dictId != 0) && (job->dictId == SessionDict_id(countryDict));
+  for (size_t idx=0; resolved && (idx<idxQty); idx++) {
+    if ( (job->bitmap[idx / 8] & (1 << (idx % 8))) && (SessionDict_lookup(countryDict, (uint8_t)idx, &code) != MPA_SUCCESS) ) {
+      resolved = false;
+    }
+  }
+  if (!resolved) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Lender country map does not match country dictionary %u. Requesting full set.",
+            SessionDict_id(countryDict));
+    forgetDataTags();
+    comm_enqMsg(comm_msg_create(MESSAGE_KEY_SYNC_RESET, lenderCountrySet.syncName, MSG_PRIORITY_INTERACTIVE));
+    return MPA_SUCCESS;
   }
-  APP_LOG(APP_LOG_LEVEL_INFO, "Kiva active country total: %d", kivaCountryQty);
 
+  if ( (mpaRet = KivaModel_clearLenderCountries(dataModel)) != MPA_SUCCESS) { return mpaRet; }
+  for (size_t idx=0; idx<idxQty; idx++) {
+    if (!(job->bitmap[idx / 8] & (1 << (idx % 8)))) { continue; }
+    SessionDict_lookup(countryDict, (uint8_t)idx, &code);
+    if ( (mpaRet = KivaModel_addLenderCountry(dataModel, code, NULL)) != MPA_SUCCESS) { return mpaRet; }
+  }
+  // The map is not a generation that a delta could be based on.
+  lenderCountryTransfer.syncGen = 0;
+  lenderCountrySetDone();
   return MPA_SUCCESS;
+}
 
-freemem:
-  for (idx = 0; idx < num_strings; idx ++) {
-    if (strings[idx] != NULL) { free(strings[idx]);  strings[idx] = NULL; }
+
+/////////////////////////////////////////////////////////////////////////////
+/// WorkQueue completion: frees the map and refreshes the View.
+/////////////////////////////////////////////////////////////////////////////
+static void countryMapJob_done(void* context, MagPebApp_ErrCode result, bool cancelled) {
+  if ( !cancelled && (result != MPA_SUCCESS) ) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Error applying lender country map: %s", MagPebApp_getErrMsg(result));
+  }
+  free(context);
+  if (!cancelled) { notifyViewData(); }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// The phone sends a LENDER_COUNTRY_MAP in place of a LENDER_COUNTRY_SET
+/// once every country of the lender has been defined in this session. It
+/// is queued like a lender country chunk, so that a later full set
+/// supersedes it.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode handleLenderCountryMap(Tuple* tuple, const TransferHeader* header) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  if (tuple->type != TUPLE_BYTE_ARRAY) { return MPA_INVALID_INPUT_ERR; }
+
+  CountryMapJob* job = malloc(sizeof(*job) + tuple->length);
+  if (job == NULL) { return MPA_OUT_OF_MEMORY_ERR; }
+  job->dictId = header->dictId;
+  job->len = tuple->length;
+  memcpy(job->bitmap, tuple->value->data, tuple->length);
+
+  if ( (mpaRet = WorkQueue_enqueue(ingestQueue, countryMapJob_step, countryMapJob_done, job, &lenderCountrySet)) != MPA_SUCCESS) {
+    free(job);  job = NULL;
+  }
+  return mpaRet;
+}
+
+
+// InboxHandler is a pointer to a function that acts on one tuple of an
+// inbox dictionary.
+typedef MagPebApp_ErrCode (*InboxHandler)(Tuple* tuple, const TransferHeader* header);
+
+static MagPebApp_ErrCode handleNotModified(Tuple* tuple, const TransferHeader* header);
+
+typedef enum InboxRouteId {
+  ROUTE_PEBKIT_READY = 0,
+  ROUTE_KIVA_COUNTRY_SET,
+  ROUTE_LENDER_ID,
+  ROUTE_LENDER_NAME,
+  ROUTE_LENDER_LOC,
+  ROUTE_LENDER_LOAN_QTY,
+  ROUTE_LENDER_COUNTRY_SET,
+  ROUTE_LENDER_COUNTRY_MAP,
+  ROUTE_LOAN_SET,
+  ROUTE_NOT_MODIFIED,
+
+  ROUTE_QTY
+} InboxRouteId;
+
+#define ROUTE_BIT(ID) ((uint32_t)1 << (ID))
+
+// Routes an inbox message key to its handler.
+typedef struct InboxRoute {
+  const uint32_t* key;          ///< message key (the keys are link-time variables)
+  const char*     readable;
+  InboxHandler    handle;
+  uint32_t        after;        ///< routes that must run first when they arrive in the same dictionary
+} InboxRoute;
+
+/////////////////////////////////////////////////////////////////////////////
+/// Inbox dispatch table. Lender data follows the Kiva country list, so
+/// that country names resolve; a lender's countries follow the lender ID,
+/// which resets their sync generation; preferred loans follow the lender's
+/// countries.
+/////////////////////////////////////////////////////////////////////////////
+static const InboxRoute inboxRoutes[ROUTE_QTY] = {
+  [ROUTE_PEBKIT_READY]       = { &MESSAGE_KEY_PEBKIT_READY,       "PebbleKit ready",               handlePebkitReady,      0 },
+  [ROUTE_KIVA_COUNTRY_SET]   = { &MESSAGE_KEY_KIVA_COUNTRY_SET,   "Kiva-served countries",         handleKivaCountrySet,   0 },
+  [ROUTE_LENDER_ID]          = { &MESSAGE_KEY_LENDER_ID,          "Lender Id",                     handleLenderId,         ROUTE_BIT(ROUTE_KIVA_COUNTRY_SET) },
+  [ROUTE_LENDER_NAME]        = { &MESSAGE_KEY_LENDER_NAME,        "Lender Name",                   handleLenderName,       ROUTE_BIT(ROUTE_LENDER_ID) },
+  [ROUTE_LENDER_LOC]         = { &MESSAGE_KEY_LENDER_LOC,         "Lender Location",               handleLenderLoc,        ROUTE_BIT(ROUTE_LENDER_ID) },
+  [ROUTE_LENDER_LOAN_QTY]    = { &MESSAGE_KEY_LENDER_LOAN_QTY,    "Lender Loan Quantity",          handleLenderLoanQty,    ROUTE_BIT(ROUTE_LENDER_ID) },
+  [ROUTE_LENDER_COUNTRY_SET] = { &MESSAGE_KEY_LENDER_COUNTRY_SET, "lender-supported countries",    handleLenderCountrySet, ROUTE_BIT(ROUTE_KIVA_COUNTRY_SET) | ROUTE_BIT(ROUTE_LENDER_ID) },
+  [ROUTE_LENDER_COUNTRY_MAP] = { &MESSAGE_KEY_LENDER_COUNTRY_MAP, "lender-supported country map", handleLenderCountryMap, ROUTE_BIT(ROUTE_KIVA_COUNTRY_SET) | ROUTE_BIT(ROUTE_LENDER_ID) },
+  [ROUTE_LOAN_SET]           = { &MESSAGE_KEY_LOAN_SET,           "preferred loans",               handlePreferredLoanSet, ROUTE_BIT(ROUTE_LENDER_COUNTRY_SET) | ROUTE_BIT(ROUTE_LENDER_COUNTRY_MAP) },
+  [ROUTE_NOT_MODIFIED]       = { &MESSAGE_KEY_NOT_MODIFIED,       "unchanged data",                handleNotModified,      0 }
+};
+
+
+// The latest request of one type, matched to its responses by REQUEST_ID.
+typedef struct InflightRequest {
+  const uint32_t*  key;         ///< request message key
+  uint32_t         routes;      ///< inbox routes that answer the request
+  uint16_t         latestId;    ///< REQUEST_ID it was last sent with; 0 if never sent
+  uint32_t         sentMs;      ///< when it was last sent
+  bool             answered;    ///< the first response to latestId has arrived
+  LatencyHistogram latency;     ///< time from sending to the first response
+} InflightRequest;
+
+/////////////////////////////////////////////////////////////////////////////
+/// In-flight table. Only the latest request of each type is answered; a
+/// response that echoes an older REQUEST_ID is superseded and dropped.
+/////////////////////////////////////////////////////////////////////////////
+static InflightRequest inflightRequests[] = {
+  { .key = &MESSAGE_KEY_GET_KIVA_INFO,       .routes = ROUTE_BIT(ROUTE_KIVA_COUNTRY_SET) },
+  { .key = &MESSAGE_KEY_GET_LENDER_INFO,     .routes = ROUTE_BIT(ROUTE_LENDER_NAME) | ROUTE_BIT(ROUTE_LENDER_LOC) |
+                                                       ROUTE_BIT(ROUTE_LENDER_LOAN_QTY) | ROUTE_BIT(ROUTE_LENDER_COUNTRY_SET) |
+                                                       ROUTE_BIT(ROUTE_LENDER_COUNTRY_MAP) },
+  { .key = &MESSAGE_KEY_GET_PREFERRED_LOANS, .routes = ROUTE_BIT(ROUTE_LOAN_SET) }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the REQUEST_ID for the next outbound dictionary.
+/////////////////////////////////////////////////////////////////////////////
+static uint16_t takeRequestId() {
+  uint16_t requestId = nextRequestId++;
+  if (nextRequestId == 0) { nextRequestId = 1; }
+  return requestId;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Records that a request was handed to AppMessage, which supersedes any
+/// earlier request of the same type.
+/// @param[in]      key  Message key of the request
+/// @param[in]      requestId  REQUEST_ID of its dictionary
+/////////////////////////////////////////////////////////////////////////////
+static void trackRequest(uint32_t key, uint16_t requestId) {
+  for (size_t idx=0; idx<ARRAY_LENGTH(inflightRequests); idx++) {
+    InflightRequest* request = &inflightRequests[idx];
+    if (*request->key != key) { continue; }
+    request->latestId = requestId;
+    request->sentMs = nowMs();
+    request->answered = false;
+    return;
   }
-  if (strings != NULL) { free(strings);  strings = NULL; }
-  if (state != NULL) { free(state);  state = NULL; }
-  if (countrySetBuf != NULL) { free(countrySetBuf);  countrySetBuf = NULL; }
-
-  return myret;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Deserializes a MESSAGE_KEY_KIVA_COUNTRY_SET tuple.
-///
-/// @param[in]      tuple  This tuple must be non-null and its key must
-///       match MESSAGE_KEY_KIVA_COUNTRY_SET.
-///
-/// @return  MPA_SUCCESS on success
-///          MPA_NULL_POINTER_ERR if parameters tuple or ... is
-///            NULL upon entry.
-///          MPA_OUT_OF_MEMORY_ERR if a memory allocation fails
-///
+/// Matches a routed tuple against the in-flight table. The first response
+/// to the latest request of a type records its round-trip time.
+/// @param[in]      route  Inbox route of the tuple
+/// @param[in]      requestId  REQUEST_ID echoed by the phone; 0 if none
+/// @return  false if the tuple answers a superseded request
 /////////////////////////////////////////////////////////////////////////////
-static MagPebApp_ErrCode unloadPreferredLoanSet(Tuple* tuple) {
-  MPA_RETURN_IF_NULL(tuple);
+static bool acceptResponse(size_t route, uint16_t requestId) {
+  // Unsolicited messages, like settings, are always accepted.
+  if (requestId == 0) { return true; }
 
-  size_t bufsize = strlen(tuple->value->cstring)+1;
-  const char* readable = "Preferred Loans";
-  char* loanSetBuf = NULL;
-  ProcessingState* state = NULL;
-  uint16_t num_fields = 0;
-  uint16_t idx = 0;
-  char* name = NULL;
-  char* use = NULL;
-  char* countryCode = NULL;
-  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  for (size_t idx=0; idx<ARRAY_LENGTH(inflightRequests); idx++) {
+    InflightRequest* request = &inflightRequests[idx];
+    if (!(request->routes & ROUTE_BIT(route))) { continue; }
+
+    if ( (request->latestId == 0) || ((int16_t)(requestId - request->latestId) < 0) ) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Dropping %s for superseded request %u.", inboxRoutes[route].readable, requestId);
+      return false;
+    }
+    if ( (requestId == request->latestId) && !request->answered ) {
+      uint32_t elapsed = nowMs() - request->sentMs;
+      uint32_t p50 = 0, p90 = 0;
+      request->answered = true;
+      LatencyHistogram_record(&request->latency, elapsed);
+      LatencyHistogram_percentile(&request->latency, 50, &p50);
+      LatencyHistogram_percentile(&request->latency, 90, &p90);
+      APP_LOG(APP_LOG_LEVEL_INFO, "Request %lu answered in %lu ms (p50 %lu, p90 %lu, n=%u).", (unsigned long)*request->key,
+              (unsigned long)elapsed, (unsigned long)p50, (unsigned long)p90, request->latency.total);
+    }
+    return true;
+  }
+  return true;
+}
 
 
-  if ( (loanSetBuf = malloc(bufsize)) == NULL) { goto freemem; }
+// How the part of an answer that the phone reports unchanged is handled.
+typedef struct DataPartConfig {
+  size_t route;                         ///< inbox route that stands for the part's request in the in-flight table
+  void   (*request)(MsgPriority);       ///< asks for the part again
+  void   (*onUnchanged)(void);          ///< follow-up, as if the part had been received; may be NULL
+} DataPartConfig;
 
-  if (!unloadTupleStr(&loanSetBuf, bufsize, tuple, readable)) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Error in unloadTupleStr.");
-    goto freemem;
-  }
+/////////////////////////////////////////////////////////////////////////////
+/// Answer parts. The lender's countries are followed by a refresh of the
+/// preferred loans whether or not they changed.
+/////////////////////////////////////////////////////////////////////////////
+static const DataPartConfig dataParts[DATA_PART_QTY] = {
+  [DATA_PART_NONE]           = { ROUTE_QTY,                NULL,                  NULL },
+  [DATA_PART_LENDER_PROFILE] = { ROUTE_LENDER_NAME,        requestLenderInfo,     NULL },
+  [DATA_PART_LENDER_LOANS]   = { ROUTE_LENDER_COUNTRY_SET, requestLenderInfo,     lenderCountrySetDone },
+  [DATA_PART_LOAN_SET]       = { ROUTE_LOAN_SET,           requestPreferredLoans, NULL }
+};
 
-  if ( (mpaRet = KivaModel_clearPreferredLoans(dataModel)) != MPA_SUCCESS) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Error clearing preferred loan list: %s", MagPebApp_getErrMsg(mpaRet));
-    return mpaRet;
-  }
-
-  if ( (state = data_processor_create(loanSetBuf, '|')) == NULL) { goto freemem; }
-  num_fields = data_processor_count(state);
-  APP_LOG(APP_LOG_LEVEL_INFO, "Found %d loans of interest. (%d fields)", num_fields/6, num_fields);
-  for (idx = 0; idx < num_fields; idx += 6) {
-    uint32_t id =        data_processor_get_int(state);
-    name =               data_processor_get_string(state);
-    use =                data_processor_get_string(state);
-    countryCode =        data_processor_get_string(state);
-    uint16_t fundedAmt = data_processor_get_int(state);
-    uint16_t loanAmt =   data_processor_get_int(state);
-    APP_LOG(APP_LOG_LEVEL_INFO, "[%ld] [%s] [%s] [%d] [%d] [%s]", id, name, countryCode, fundedAmt, loanAmt, use);
-    if ( (mpaRet = KivaModel_addPreferredLoan(dataModel, (LoanInfo) {
-            .id =          id,
-            .name =        name,
-            .use =         use,
-            .countryCode = countryCode,
-            .fundedAmt =   fundedAmt,
-            .loanAmt =     loanAmt
-          })) != MPA_SUCCESS) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Error adding preferred loan to data model: %s", MagPebApp_getErrMsg(mpaRet));
-    }
-    if (name != NULL) { free(name);  name = NULL; }
-    if (use != NULL) { free(use);  use = NULL; }
-    if (countryCode != NULL) { free(countryCode);  countryCode = NULL; }
+
+/////////////////////////////////////////////////////////////////////////////
+/// The phone answers a conditional request with NOT_MODIFIED, carrying the
+/// DATA_TAG it matched, for each part of the answer that is unchanged. A
+/// tag that the model no longer holds (such as one from a request made
+/// before a failed transfer) is not trusted; the part is asked for again.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode handleNotModified(Tuple* tuple, const TransferHeader* header) {
+  uint32_t tag = tuple->value->uint32;
+  uint32_t part = tag >> DATA_TAG_PART_SHIFT;
+  if ( (part == DATA_PART_NONE) || (part >= DATA_PART_QTY) ) { return MPA_INVALID_INPUT_ERR; }
+  if (!acceptResponse(dataParts[part].route, header->requestId)) { return MPA_SUCCESS; }
+
+  if (tag != dataTags[part]) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Phone matched data tag %08lx, but the model holds %08lx. Requesting again.",
+            (unsigned long)tag, (unsigned long)dataTags[part]);
+    dataTags[part] = 0;
+    (*dataParts[part].request)(MSG_PRIORITY_PREFETCH);
+    return MPA_SUCCESS;
   }
-  if (state != NULL) { free(state);  state = NULL; }
-  if (loanSetBuf != NULL) { free(loanSetBuf);  loanSetBuf = NULL; }
 
+  APP_LOG(APP_LOG_LEVEL_INFO, "Data tag %08lx is unchanged.", (unsigned long)tag);
+  if (dataParts[part].onUnchanged != NULL) { (*dataParts[part].onUnchanged)(); }
   return MPA_SUCCESS;
-
-freemem:
-  if (name != NULL) { free(name);  name = NULL; }
-  if (use != NULL) { free(use);  use = NULL; }
-  if (countryCode != NULL) { free(countryCode);  countryCode = NULL; }
-  if (state != NULL) { free(state);  state = NULL; }
-  if (loanSetBuf != NULL) { free(loanSetBuf);  loanSetBuf = NULL; }
-
-  return MPA_OUT_OF_MEMORY_ERR;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Handles callbacks from the JS component
+/// Handles callbacks from the JS component. The dictionary is read in a
+/// single pass; its tuples are then handed to their handlers in an order
+/// that honours each route's dependencies.
 /////////////////////////////////////////////////////////////////////////////
 static void inbox_received_callback(DictionaryIterator *iterator, void *context) {
   APP_LOG(APP_LOG_LEVEL_INFO, "Inbox receive successful.");
 
   MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
-  Tuple *tuple = NULL;
-  
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_PEBKIT_READY)) != NULL ) {
-    // PebbleKit JS is ready! Safe to send messages
-    pebkitReady = true;
-    APP_LOG(APP_LOG_LEVEL_INFO, "PebbleKit JS sent ready message!");
-    
-    comm_enqMsg(comm_msg_create(MESSAGE_KEY_GET_KIVA_INFO, ""));
-    
-    bool empty = true;
-    if ( (sendBuffer != NULL) && ( (mpaRet = RingBuffer_empty(sendBuffer, &empty)) != MPA_SUCCESS) ) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error checking sendBuffer: %s", MagPebApp_getErrMsg(mpaRet));
-        return;
-    }
-    if (!empty) { comm_sendBufMsg(); }
-  }
-
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_KIVA_COUNTRY_SET)) != NULL ) {
-    if ( (mpaRet = unloadKivaCountrySet(tuple)) != MPA_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error retrieving Kiva-served countries: %s", MagPebApp_getErrMsg(mpaRet));
-      return;
+  // Without a header, a message is a full, untracked transfer of a single chunk.
+  TransferHeader transferHeader = { .transferId = 0, .seq = 0, .qty = 1, .syncGen = 0, .baseGen = 0, .removeSet = NULL, .requestId = 0,
+                                    .dictId = 0, .protoCaps = 0, .dataTag = 0 };
+  Tuple* routed[ROUTE_QTY] = { NULL };
+  uint32_t pending = 0;
+  size_t bytes = 1;
+
+  for (Tuple* tuple = dict_read_first(iterator); tuple != NULL; tuple = dict_read_next(iterator)) {
+    bytes += sizeof(Tuple) + tuple->length;
+    if (readHeaderTuple(&transferHeader, tuple)) { continue; }
+
+    size_t route = 0;
+    while ( (route < ROUTE_QTY) && (*inboxRoutes[route].key != tuple->key) ) { route++; }
+    if (route == ROUTE_QTY) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Ignoring unknown message key %lu.", (unsigned long)tuple->key);
+      continue;
     }
-    // Ready to load saved data (like Lender ID) from persistent memory now.
-    comm_loadPersistent();
+    routed[route] = tuple;
+    pending |= ROUTE_BIT(route);
   }
 
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_LENDER_ID)) != NULL ) {
-    const char* readable = "Lender Id";
-    size_t bufsize = strlen(tuple->value->cstring)+1;
-    char* lenderIdBuf = NULL;
-    lenderIdBuf = malloc(bufsize);
-    if (!unloadTupleStr(&lenderIdBuf, bufsize, tuple, readable)) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error in unloadTupleStr.");
-    } else {
-      APP_LOG(APP_LOG_LEVEL_INFO, "lenderIdBuf = %s", lenderIdBuf);
-      if ( (mpaRet = KivaModel_setLenderId(dataModel, lenderIdBuf)) != MPA_SUCCESS) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Error setting %s in data model: %s", readable, MagPebApp_getErrMsg(mpaRet));
-      }
-    }
-    if (lenderIdBuf != NULL) { free(lenderIdBuf); lenderIdBuf = NULL; }
-    comm_savePersistent();
-    comm_getLenderInfo();
-  }
-
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_LENDER_NAME)) != NULL ) {
-    const char* readable = "Lender Name";
-    size_t bufsize = strlen(tuple->value->cstring)+1;
-    char* lenderNameBuf = NULL;
-    lenderNameBuf = malloc(bufsize);
-    if (!unloadTupleStr(&lenderNameBuf, bufsize, tuple, readable)) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error in unloadTupleStr.");
-    } else {
-      APP_LOG(APP_LOG_LEVEL_INFO, "lenderNameBuf = %s", lenderNameBuf);
-      if ( (mpaRet = KivaModel_setLenderName(dataModel, lenderNameBuf)) != MPA_SUCCESS) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Error setting %s in data model: %s", readable, MagPebApp_getErrMsg(mpaRet));
-      }
-    }
-    if (lenderNameBuf != NULL) { free(lenderNameBuf); lenderNameBuf = NULL; }
+  // The request ID is only known once the whole dictionary has been read.
+  for (size_t route=0; route<ROUTE_QTY; route++) {
+    if ( (pending & ROUTE_BIT(route)) && !acceptResponse(route, transferHeader.requestId) ) { pending &= ~ROUTE_BIT(route); }
   }
-
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_LENDER_LOC)) != NULL ) {
-    const char* readable = "Lender Location";
-    size_t bufsize = strlen(tuple->value->cstring)+1;
-    char* lenderLocBuf = NULL;
-    lenderLocBuf = malloc(bufsize);
-    if (!unloadTupleStr(&lenderLocBuf, bufsize, tuple, readable)) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error in unloadTupleStr.");
-    } else {
-      APP_LOG(APP_LOG_LEVEL_INFO, "lenderLocBuf = %s", lenderLocBuf);
-      if ( (mpaRet = KivaModel_setLenderLoc(dataModel, lenderLocBuf)) != MPA_SUCCESS) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Error setting %s in data model: %s", readable, MagPebApp_getErrMsg(mpaRet));
-      }
+  // The model holds what the tag describes only once every handler has
+  // taken its part in, and none of them has forgotten the tags meanwhile.
+  bool keepTag = (transferHeader.dataTag != 0) && (pending != 0);
+  uint32_t tagResets = dataTagResets;
+
+  while (pending != 0) {
+    uint32_t ready = 0;
+    for (size_t route=0; route<ROUTE_QTY; route++) {
+      if ( (pending & ROUTE_BIT(route)) && !(pending & inboxRoutes[route].after) ) { ready |= ROUTE_BIT(route); }
     }
-    if (lenderLocBuf != NULL) { free(lenderLocBuf); lenderLocBuf = NULL; }
-  }
-
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_LENDER_LOAN_QTY)) != NULL ) {
-    const char* readable = "Lender Loan Quantity";
-    long int lenderLoanQty = 0;
-    if (unloadTupleLong(&lenderLoanQty, tuple, readable)) {
-      if ( (mpaRet = KivaModel_setLenderLoanQty(dataModel, (int)lenderLoanQty)) != MPA_SUCCESS) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Error setting %s in data model: %s", readable, MagPebApp_getErrMsg(mpaRet));
-      }
+    if (ready == 0) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Inbox routes depend on each other; dropping %lx.", (unsigned long)pending);
+      keepTag = false;
+      break;
     }
-  }
 
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_LENDER_COUNTRY_SET)) != NULL ) {
-    const char* readable = "Lender-Supported Countries";
-    size_t bufsize = strlen(tuple->value->cstring)+1;
-    char* countrySetBuf = NULL;
-    countrySetBuf = malloc(bufsize);
-    if (!unloadTupleStr(&countrySetBuf, bufsize, tuple, readable)) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error in unloadTupleStr.");
-    } else {
-      ProcessingState* state = data_processor_create(countrySetBuf, '|');
-      uint16_t num_strings = data_processor_count(state);
-      char** strings = malloc(sizeof(char*) * num_strings);
-      for (uint16_t n = 0; n < num_strings; n += 2) {
-        strings[n] = data_processor_get_string(state);
-        strings[n+1] = data_processor_get_string(state);
-        if ( (mpaRet = KivaModel_addLenderCountry(dataModel, strings[n], strings[n+1])) != MPA_SUCCESS) {
-            APP_LOG(APP_LOG_LEVEL_ERROR, "Error adding Lender country to data model: %s", MagPebApp_getErrMsg(mpaRet));
-        }
-        if (strings[n] != NULL) { free(strings[n]); strings[n] = NULL; }
-        if (strings[n+1] != NULL) { free(strings[n+1]); strings[n+1] = NULL; }
+    for (size_t route=0; route<ROUTE_QTY; route++) {
+      if (!(ready & ROUTE_BIT(route))) { continue; }
+      if ( (mpaRet = (*inboxRoutes[route].handle)(routed[route], &transferHeader)) != MPA_SUCCESS) {
+        APP_LOG(APP_LOG_LEVEL_ERROR, "Error handling %s: %s", inboxRoutes[route].readable, MagPebApp_getErrMsg(mpaRet));
+        keepTag = false;
       }
-      if (strings != NULL) { free(strings); strings = NULL; }
-      if (state != NULL) { free(state); state = NULL; }
-    }
-    if (countrySetBuf != NULL) { free(countrySetBuf); countrySetBuf = NULL; }
-    comm_getPreferredLoans();
-  }
-
-  if ( (tuple = dict_find(iterator, MESSAGE_KEY_LOAN_SET)) != NULL ) {
-    if ( (mpaRet = unloadPreferredLoanSet(tuple)) != MPA_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error retrieving preferred loans: %s", MagPebApp_getErrMsg(mpaRet));
-      return;
     }
+    pending &= ~ready;
   }
+  if (keepTag && (dataTagResets == tagResets)) { keepDataTag(transferHeader.dataTag); }
 
-  if (!commHandlers.updateViewData) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Attempted operation on NULL pointer.");
-  } else {
-    (*commHandlers.updateViewData)(dataModel);
-  }
+  // Counted after dispatch, so that a message that opens a session counts.
+  TransferSession_count(transferSession, bytes);
 
+  // Record sets refresh the View again once their ingest has finished.
+  notifyViewData();
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
+/// A message that did not fit the inbox asks the phone for smaller
+/// chunks; the chunk itself is requested again once it is found missing.
+/// Older scripts cannot size their messages, so they are not asked.
 /////////////////////////////////////////////////////////////////////////////
 static void inbox_dropped_callback(AppMessageResult reason, void *context) {
   APP_LOG(APP_LOG_LEVEL_ERROR, "Inbox receive failed! Reason: %d", (int)reason);
+  if ( (reason != APP_MSG_BUFFER_OVERFLOW) || (chunkSize <= CHUNK_SIZE_MIN) || (peerVersion < 2) ) { return; }
+
+  chunkSize = (chunkSize / 2 > CHUNK_SIZE_MIN) ? chunkSize / 2 : CHUNK_SIZE_MIN;
+  APP_LOG(APP_LOG_LEVEL_WARNING, "Requesting chunks of at most %lu bytes.", (unsigned long)chunkSize);
+  char size[12];
+  snprintf(size, sizeof(size), "%lu", (unsigned long)chunkSize);
+  comm_enqMsg(comm_msg_create(MESSAGE_KEY_CHUNK_SIZE, size, MSG_PRIORITY_INTERACTIVE));
 }
 
 
@@ -384,14 +1331,67 @@ static void inbox_dropped_callback(AppMessageResult reason, void *context) {
 /////////////////////////////////////////////////////////////////////////////
 static void outbox_failed_callback(DictionaryIterator *iterator, AppMessageResult reason, void *context) {
   APP_LOG(APP_LOG_LEVEL_ERROR, "Outbox send failed! Reason: %d", (int)reason);
+  // Acknowledgements arrive in send order, so the failure belongs to the
+  // oldest dictionary. Everything in flight is batched and sent again.
+  sendInFlight = 0;
+  BatchRing_init(&sendBatches);
   comm_startResendTimer();
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
+/// Retires the messages of the acknowledged dictionary and keeps the send
+/// window full.
 /////////////////////////////////////////////////////////////////////////////
 static void outbox_sent_callback(DictionaryIterator *iterator, void *context) {
   APP_LOG(APP_LOG_LEVEL_INFO, "Outbox send successful.");
+
+  uint8_t batchLen = 0;
+  if (BatchRing_pop(&sendBatches, &batchLen) == MPA_SUCCESS) {
+    for (uint8_t idx=0; idx<batchLen; idx++) {
+      void* data = NULL;
+      if (RingBuffer_read(sendWindow, &data) == MPA_SUCCESS) {
+        APP_LOG(APP_LOG_LEVEL_INFO, "Phone acknowledged message %d.", (int)((Message*)data)->key);
+        comm_msg_destroy((Message*)data);
+      }
+    }
+    sendInFlight -= batchLen;
+    RetryPolicy_succeeded(sendRetry);
+  }
+
+  comm_sendBufMsg();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// ConnectionHandler for the phone's Pebble app. While it is away, sending
+/// and retries stop and messages stay queued, so that neither attempts nor
+/// the retry budget are spent on a link that is down. On reconnect the
+/// queue is flushed and data that missed a refresh is brought up to date.
+/////////////////////////////////////////////////////////////////////////////
+static void appConnectionHandler(bool connected) {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Phone %s.", connected ? "reconnected" : "disconnected");
+  phoneConnected = connected;
+  RetryPolicy_reset(sendRetry);
+  if (!connected) { return; }
+
+  void* data = NULL;
+  for (size_t idx=0; RingBuffer_peekAt(sendWindow, idx, &data) == MPA_SUCCESS; idx++) {
+    ((Message*)data)->attempts = 0;
+  }
+  if (refreshMissed) {
+    refreshMissed = false;
+    requestLenderInfo(MSG_PRIORITY_PREFETCH);
+  }
+  comm_sendBufMsg();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// RetryPolicy callback: retries the buffered messages after a backoff.
+/////////////////////////////////////////////////////////////////////////////
+static void sendRetryCallback(void* data) {
+  comm_sendBufMsg();
 }
 
 
@@ -404,7 +1404,72 @@ bool comm_pebkitReady() {
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Queue data and send to PebbleKit.
+/// Returns whether a request with this key is superseded by a newer one,
+/// even when the payloads differ (the latest parameters win).
+/////////////////////////////////////////////////////////////////////////////
+static bool latestWins(uint32_t key) {
+  return (key == MESSAGE_KEY_GET_LENDER_INFO) || (key == MESSAGE_KEY_GET_PREFERRED_LOANS) || (key == MESSAGE_KEY_CHUNK_SIZE);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// SendMatch: a queued message with the same key.
+/////////////////////////////////////////////////////////////////////////////
+static bool sameKey(const void* item, const void* context) {
+  return ((const Message*)item)->key == ((const Message*)context)->key;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// SendMatch: a queued message with the same key and payload.
+/////////////////////////////////////////////////////////////////////////////
+static bool sameRequest(const void* item, const void* context) {
+  const Message* queued = (const Message*) item;
+  const Message* msg = (const Message*) context;
+  return (queued->key == msg->key) && (strcmp(queued->payload, msg->payload) == 0);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Merges a new message into an equivalent one that is already pending.
+/// A request identical to one waiting for its acknowledgement is dropped.
+/// A queued match is dropped in favour of the new message, which keeps the
+/// higher of the two priorities.
+/// @return  true if msg was merged away (and destroyed)
+/////////////////////////////////////////////////////////////////////////////
+static bool coalesceMsg(Message* msg) {
+  void* data = NULL;
+  for (size_t idx=0; RingBuffer_peekAt(sendWindow, idx, &data) == MPA_SUCCESS; idx++) {
+    if (sameRequest(data, msg)) {
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "Message %d is already in flight.", (int)msg->key);
+      comm_msg_destroy(msg);
+      return true;
+    }
+  }
+
+  SendMatch match = latestWins(msg->key) ? sameKey : sameRequest;
+  uint8_t cls = 0;
+  if (SendScheduler_find(sendScheduler, match, msg, &data, &cls) != MPA_SUCCESS) { return false; }
+
+  Message* queued = (Message*) data;
+  if ( sameRequest(queued, msg) && (cls <= msg->priority) ) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Message %d is already queued.", (int)msg->key);
+    comm_msg_destroy(msg);
+    return true;
+  }
+
+  // Superseded, or promoted to the new message's priority class.
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Message %d replaces a queued one.", (int)msg->key);
+  if (queued->priority < msg->priority) { msg->priority = queued->priority; }
+  SendScheduler_remove(sendScheduler, queued);
+  comm_msg_destroy(queued);
+  return false;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Queue data and send to PebbleKit. Requests that are already pending
+/// are coalesced rather than queued twice.
 /////////////////////////////////////////////////////////////////////////////
 void comm_enqMsg(Message* msg) {
   MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
@@ -413,87 +1478,156 @@ void comm_enqMsg(Message* msg) {
     return;
   }
   
-  if (sendBuffer == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Send buffer is null.");
+  if (sendScheduler == NULL) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Send scheduler is null.");
+    comm_msg_destroy(msg);
     return;
   }
   
-  if ( (mpaRet = RingBuffer_write(sendBuffer, (void*)msg)) != MPA_SUCCESS) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Error buffering message: %s", MagPebApp_getErrMsg(mpaRet));
+  // Every message must fit an otherwise empty outbox on its own.
+  if (dict_calc_buffer_size(2, sizeof(uint16_t), strlen(msg->payload) + 1) > OUTBOX_SIZE) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Message %d is too large for the outbox.", (int)msg->key);
+    comm_msg_destroy(msg);
+    return;
+  }
+
+  if (coalesceMsg(msg)) { return; }
+
+  void* evicted = NULL;
+  if ( (mpaRet = SendScheduler_push(sendScheduler, msg->priority, (void*)msg, &evicted)) != MPA_SUCCESS) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Refused message %d (priority %d): %s", (int)msg->key, (int)msg->priority, MagPebApp_getErrMsg(mpaRet));
     comm_msg_destroy(msg);
     return;
   }
+  if (evicted != NULL) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Queue full; evicted message %d (priority %d).", (int)((Message*)evicted)->key, (int)msg->priority);
+    comm_msg_destroy((Message*)evicted);
+  }
   
   comm_sendBufMsg();
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Send buffered data to PebbleKit.
+/// Returns the unsent message at the specified position of the send window,
+/// taking the next one from the scheduler when the window ends there.
+/// @return  the message, or NULL if there is none or the window is full
 /////////////////////////////////////////////////////////////////////////////
-void comm_sendBufMsg() {
-  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
-  
+static Message* peekUnsentMsg(size_t idx) {
   void* data = NULL;
-  if ( (mpaRet = RingBuffer_peek(sendBuffer, &data)) != MPA_SUCCESS) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Error reading buffered message: %s", MagPebApp_getErrMsg(mpaRet));
-    return;
-  }
-  
-  Message* msg = (Message*) data;
-  if (msg == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Send buffer contained a null message.");
-    return;
+  if (RingBuffer_peekAt(sendWindow, idx, &data) == MPA_SUCCESS) { return (Message*) data; }
+
+  bool full = true;
+  if ( (RingBuffer_full(sendWindow, &full) != MPA_SUCCESS) || full) { return NULL; }
+  if (SendScheduler_pop(sendScheduler, &data) != MPA_SUCCESS) { return NULL; }
+  if (RingBuffer_write(sendWindow, data) != MPA_SUCCESS) {
+    comm_msg_destroy((Message*)data);
+    return NULL;
   }
-  
-  // At this point, we know there is a non-null message in the send buffer.
-  
-  // Check if PebbleKit JS is ready to receive...
+  return (Message*) data;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Sends scheduled messages to PebbleKit until the send window is full.
+/// Pending requests are packed into as few dictionaries as the outbox
+/// allows. Messages stay in the window until the phone acknowledges their
+/// dictionary; the next one goes out from outbox_sent_callback, so the
+/// queues drain back to back.
+/////////////////////////////////////////////////////////////////////////////
+void comm_sendBufMsg() {
+  if ( (sendScheduler == NULL) || (sendWindow == NULL) ) { return; }
+
+  // Messages wait for PebbleKit JS; the ready message restarts sending.
   if (!comm_pebkitReady()) {
     APP_LOG(APP_LOG_LEVEL_WARNING, "Buffering message to phone until PebbleKit JS is ready...");
-    comm_startResendTimer();
     return;
   }
 
-  // Prepare the outbox buffer for this message
-  DictionaryIterator *outIter;
-  AppMessageResult result = app_message_outbox_begin(&outIter);
-  if (result != APP_MSG_OK) {
-    // The outbox cannot be used right now
-    APP_LOG(APP_LOG_LEVEL_WARNING, "Error preparing the outbox for message %d.  Result: %d", (int)msg->key, (int)result);
-    comm_startResendTimer();
-    return;
-  }
-  
-  // Ready to write to app message outbox...
-  dict_write_cstring(outIter, msg->key, msg->payload);
+  // Messages are held while the phone is away; the reconnect flushes them.
+  if (!phoneConnected) { return; }
 
-  // Send this message
-  result = app_message_outbox_send();
-    
-  if(result != APP_MSG_OK) {
-    APP_LOG(APP_LOG_LEVEL_WARNING, "Error sending the outbox for message %d.  Result: %d", (int)msg->key, (int)result);
-    comm_startResendTimer();
-    return;
+  // A pending retry keeps its backoff, and an open breaker pauses sending.
+  if (RetryPolicy_waiting(sendRetry)) { return; }
+
+  // Requests share a dictionary only with a phone that handles every one of
+  // them; others, such as scripts before protocol version 2, get one each.
+  uint8_t batchMax = (peerCaps & PROTO_CAP_BATCHED) ? SEND_BATCH_MAX : 1;
+
+  while (!BatchRing_full(&sendBatches)) {
+    // Messages rewound after a failure go out again before anything new.
+    Message* msg = peekUnsentMsg(sendInFlight);
+    if (msg == NULL) { return; }
+
+    // Prepare the outbox buffer for this message
+    DictionaryIterator *outIter;
+    AppMessageResult result = app_message_outbox_begin(&outIter);
+    if (result != APP_MSG_OK) {
+      // The outbox cannot be used right now
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Error preparing the outbox for message %d.  Result: %d", (int)msg->key, (int)result);
+      comm_startResendTimer();
+      return;
+    }
+
+    // Ready to write to app message outbox... Each key appears once per
+    // dictionary, and comm_enqMsg guarantees that the first message fits
+    // alongside the request ID.
+    uint16_t requestId = takeRequestId();
+    dict_write_uint16(outIter, MESSAGE_KEY_REQUEST_ID, requestId);
+    uint8_t batchLen = 0;
+    while (msg != NULL) {
+      bool keyTaken = false;
+      void* data = NULL;
+      for (uint8_t idx=0; idx<batchLen; idx++) {
+        RingBuffer_peekAt(sendWindow, sendInFlight + idx, &data);
+        if (((Message*)data)->key == msg->key) { keyTaken = true;  break; }
+      }
+      if (keyTaken || (dict_write_cstring(outIter, msg->key, msg->payload) != DICT_OK)) { break; }
+
+      batchLen++;
+      msg = (batchLen < batchMax) ? peekUnsentMsg(sendInFlight + batchLen) : NULL;
+    }
+
+    // Send this dictionary
+    result = app_message_outbox_send();
+
+    if(result != APP_MSG_OK) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Error sending the outbox (%d messages).  Result: %d", batchLen, (int)result);
+      comm_startResendTimer();
+      return;
+    }
+
+    // Successful send attempt! The messages are retired when they are acknowledged.
+    APP_LOG(APP_LOG_LEVEL_INFO, "Sent %d outbox message(s) as request %u!", batchLen, requestId);
+    for (uint8_t idx=0; idx<batchLen; idx++) {
+      void* data = NULL;
+      RingBuffer_peekAt(sendWindow, sendInFlight + idx, &data);
+      trackRequest(((Message*)data)->key, requestId);
+    }
+    BatchRing_push(&sendBatches, batchLen);
+    sendInFlight += batchLen;
   }
-  
-  // Successful send attempt!
-  APP_LOG(APP_LOG_LEVEL_INFO, "Sent outbox message %d!", (int)msg->key);
-  sendRetryCount = 0;
-  RingBuffer_drop(sendBuffer);
-  comm_msg_destroy(msg);
-  if (sendRetryTimer != NULL) { app_timer_cancel(sendRetryTimer);  sendRetryTimer = NULL; }
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Starts a backoff timer to retry the first message in the send buffer.
+/// Handles a failed send of the first message in the send window: its
+/// RetryPolicy schedules another attempt, which may wait for retry budget,
+/// or has it abandoned once the message has used up its attempts.
 /////////////////////////////////////////////////////////////////////////////
 void comm_startResendTimer() {
   MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+
+  // A failure while disconnected says nothing about the message; it is
+  // sent again once the phone is back.
+  if (!phoneConnected) {
+    sendInFlight = 0;
+    BatchRing_init(&sendBatches);
+    return;
+  }
   
   void* data = NULL;
-  if ( (mpaRet = RingBuffer_peek(sendBuffer, &data)) != MPA_SUCCESS) {
+  if ( (mpaRet = RingBuffer_peek(sendWindow, &data)) != MPA_SUCCESS) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Error reading buffered message: %s", MagPebApp_getErrMsg(mpaRet));
     return;
   }
@@ -504,62 +1638,74 @@ void comm_startResendTimer() {
     return;
   }
   
-  if (sendRetryCount < MAX_SEND_RETRIES) {
-    sendRetryCount++;
-    uint16_t retryIntervalMs = (sendRetryCount * 1000);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Retrying message (%d) send in %d ms...", (int)msg->key, retryIntervalMs);
-    sendRetryTimer = app_timer_register(retryIntervalMs, comm_sendBufMsg, NULL);
-  } else {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Max retries failed. Abandoning message (%d).", (int)msg->key);
-    sendRetryCount = 0;
-    RingBuffer_drop(sendBuffer);
-    if (sendRetryTimer != NULL) { app_timer_cancel(sendRetryTimer);  sendRetryTimer = NULL; }
+  bool retry = false;
+  if ( (mpaRet = RetryPolicy_failed(sendRetry, msg->priority, &msg->attempts, &retry)) != MPA_SUCCESS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Error scheduling retry: %s", MagPebApp_getErrMsg(mpaRet));
+  }
+  if (retry) {
+    APP_LOG(APP_LOG_LEVEL_INFO, "Retrying message (%d), attempt %d...", (int)msg->key, msg->attempts);
+    return;
   }
+
+  APP_LOG(APP_LOG_LEVEL_ERROR, "Retries exhausted. Abandoning message (%d).", (int)msg->key);
+  RingBuffer_drop(sendWindow);
+  comm_msg_destroy(msg);
+  sendInFlight = 0;
+  BatchRing_init(&sendBatches);
+  comm_sendBufMsg();
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Send data to PebbleKit.
+/// Makes a request conditional on the data that the model holds: the
+/// DATA_TAG of each part of its answer is appended to the payload.
+/// @param[in]      payload  Unconditional payload
+/// @param[in]      first  First DataPart of the answer
+/// @param[in]      last  Last DataPart of the answer
+/// @param[out]     conditional  Pointer to the conditional payload; must be
+///       NULL upon entry to this function, and is left NULL if the phone
+///       does not support conditional requests or no part is tagged.
+///       <em>Ownership of this string is transferred to the caller, who
+///       must free it.</em>
+/// @return  MPA_SUCCESS on success
+///          MPA_INVALID_INPUT_ERR if conditional is not NULL on entry
+///          MPA_OUT_OF_MEMORY_ERR if a memory allocation fails
 /////////////////////////////////////////////////////////////////////////////
-void comm_sendMsg(const Message* msg) {
-  if (msg == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Tried to send a null message.");
-    return;
-  }
-  
-  if (!comm_pebkitReady()) {
-    APP_LOG(APP_LOG_LEVEL_WARNING, "Tried to send a message from the watch before PebbleKit JS is ready.");
-    return;
+static MagPebApp_ErrCode appendDataTags(const char* payload, DataPart first, DataPart last, char** conditional) {
+  MPA_RETURN_IF_NULL(payload);
+  MPA_RETURN_IF_NULL(conditional);
+  if (*conditional != NULL) { return MPA_INVALID_INPUT_ERR; }
+  if (!(peerCaps & PROTO_CAP_NOT_MODIFIED)) { return MPA_SUCCESS; }
+
+  uint8_t taggedQty = 0;
+  for (uint8_t part=first; part<=last; part++) {
+    if (dataTags[part] != 0) { taggedQty++; }
   }
-
-  // Declare the dictionary's iterator
-  DictionaryIterator *outIter;
-
-  // Prepare the outbox buffer for this message
-  AppMessageResult result = app_message_outbox_begin(&outIter);
-  if (result == APP_MSG_OK) {
-    dict_write_cstring(outIter, msg->key, msg->payload);
-
-    // Send this message
-    result = app_message_outbox_send();
-  
-    if(result == APP_MSG_OK) {
-      APP_LOG(APP_LOG_LEVEL_INFO, "Sent outbox message %d!", (int)msg->key);
-    } else {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Error sending the outbox for message %d.  Result: %d", (int)msg->key, (int)result);
-    }
-    
-  } else {
-    // The outbox cannot be used right now
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Error preparing the outbox for message %d.  Result: %d", (int)msg->key, (int)result);
+  if (taggedQty == 0) { return MPA_SUCCESS; }
+
+  size_t size = strlen(payload) + taggedQty * 9 + 1;
+  char* str = malloc(size);
+  if (str == NULL) { return MPA_OUT_OF_MEMORY_ERR; }
+
+  int len = snprintf(str, size, "%s", payload);
+  char sep = DATA_TAG_SEP;
+  for (uint8_t part=first; part<=last; part++) {
+    if (dataTags[part] == 0) { continue; }
+    len += snprintf(str + len, size - len, "%c%08lx", sep, (unsigned long)dataTags[part]);
+    sep = '.';
   }
+  *conditional = str;
+  return MPA_SUCCESS;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
 /// Requests PebbleKit to send lender information (name, location, etc).
+/// The request is conditional, so that an unchanged lender costs the phone
+/// a NOT_MODIFIED per part rather than the data itself.
+/// @param[in]      priority  Scheduling class of the request
 /////////////////////////////////////////////////////////////////////////////
-void comm_getLenderInfo() {
+static void requestLenderInfo(MsgPriority priority) {
   if (dataModel == NULL) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Kiva Model is not yet initialized.");
     return;
@@ -572,15 +1718,32 @@ void comm_getLenderInfo() {
     return;
   }
 
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Get lender info for ID: %s", lenderId);
-  comm_enqMsg(comm_msg_create(MESSAGE_KEY_GET_LENDER_INFO, lenderId));
+  char* conditional = NULL;
+  if ( (mpaRet = appendDataTags(lenderId, DATA_PART_LENDER_PROFILE, DATA_PART_LENDER_LOANS, &conditional)) != MPA_SUCCESS) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Requesting lender info unconditionally: %s", MagPebApp_getErrMsg(mpaRet));
+  }
+
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Get lender info for ID: %s", (conditional != NULL) ? conditional : lenderId);
+  comm_enqMsg(comm_msg_create(MESSAGE_KEY_GET_LENDER_INFO, (conditional != NULL) ? conditional : lenderId, priority));
+  if (conditional != NULL) { free(conditional); conditional = NULL; }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Requests PebbleKit to send lender information on behalf of the user.
+/////////////////////////////////////////////////////////////////////////////
+void comm_getLenderInfo() {
+  requestLenderInfo(MSG_PRIORITY_INTERACTIVE);
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
 /// Requests PebbleKit to send a list of preferred loans for the lender.
+/// The countries are sent as a coverage bitmap of countryDict indices when
+/// every one of them has an index, and as a list of codes otherwise.
+/// @param[in]      priority  Scheduling class of the request
 /////////////////////////////////////////////////////////////////////////////
-void comm_getPreferredLoans() {
+static void requestPreferredLoans(MsgPriority priority) {
     if (dataModel == NULL) {
       APP_LOG(APP_LOG_LEVEL_ERROR, "Kiva Model is not yet initialized.");
       return;
@@ -588,17 +1751,145 @@ void comm_getPreferredLoans() {
 
     MagPebApp_ErrCode mpaRet;
     char* countryCodes = NULL;
+    char* coverage = NULL;
+    char* coded = NULL;
+    char* conditional = NULL;
     if ( (mpaRet = KivaModel_getLenderCountryCodes(dataModel, false, &countryCodes)) != MPA_SUCCESS) {
       APP_LOG(APP_LOG_LEVEL_ERROR, "Could not retrieve lender country codes: %s", MagPebApp_getErrMsg(mpaRet));
       return;
     }
 
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Get loans for country codes: %s", countryCodes);
-    comm_enqMsg(comm_msg_create(MESSAGE_KEY_GET_PREFERRED_LOANS, countryCodes));
+    if ( (countryCodes != NULL) && (peerCaps & PROTO_CAP_COUNTRY_DICT) && (SessionDict_id(countryDict) != 0) &&
+         (SessionDict_coverage(countryDict, countryCodes, ',', &coverage) == MPA_SUCCESS) ) {
+      size_t size = 4 + 1 + strlen(coverage) + 1;
+      if ( (coded = malloc(size)) != NULL) {
+        snprintf(coded, size, "%04x%c%s", SessionDict_id(countryDict), COUNTRY_DICT_SEP, coverage);
+      }
+      free(coverage);  coverage = NULL;
+    }
+
+    const char* payload = (coded != NULL) ? coded : countryCodes;
+    if ( (payload != NULL) &&
+         ((mpaRet = appendDataTags(payload, DATA_PART_LOAN_SET, DATA_PART_LOAN_SET, &conditional)) != MPA_SUCCESS) ) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Requesting loans unconditionally: %s", MagPebApp_getErrMsg(mpaRet));
+    }
+    if (conditional != NULL) { payload = conditional; }
+
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Get loans for country codes: %s", payload);
+    comm_enqMsg(comm_msg_create(MESSAGE_KEY_GET_PREFERRED_LOANS, payload, priority));
+    if (conditional != NULL) { free(conditional); conditional = NULL; }
+    if (coded != NULL) { free(coded); coded = NULL; }
     if (countryCodes != NULL) { free(countryCodes); countryCodes = NULL; }
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+/// Requests PebbleKit to send preferred loans on behalf of the user.
+/////////////////////////////////////////////////////////////////////////////
+void comm_getPreferredLoans() {
+  requestPreferredLoans(MSG_PRIORITY_INTERACTIVE);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether a message is still worth sending after the app restarts.
+/// Chunk resends and sync resets refer to transfers that do not survive,
+/// and the size handshake is repeated on every PEBKIT_READY. Requests coded
+/// against the session dictionary die with the session, and conditional
+/// requests with the model they were conditional on.
+/////////////////////////////////////////////////////////////////////////////
+static bool outlivesLaunch(uint32_t key, const char* payload) {
+  if (strchr(payload, DATA_TAG_SEP) != NULL) { return false; }
+  if (key == MESSAGE_KEY_GET_PREFERRED_LOANS) { return (strchr(payload, COUNTRY_DICT_SEP) == NULL); }
+  return (key == MESSAGE_KEY_GET_KIVA_INFO) || (key == MESSAGE_KEY_GET_LENDER_INFO);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Writes one undelivered message to persistent storage.
+/// @return  true if the message was saved
+/////////////////////////////////////////////////////////////////////////////
+static bool saveQueuedMsg(const Message* msg, uint32_t persistKey) {
+  uint8_t buf[PERSIST_DATA_MAX_LENGTH];
+  size_t len = strlen(msg->payload);
+  if (SAVED_MSG_HEADER_SIZE + len > sizeof(buf)) { return false; }
+
+  uint32_t queuedAt = (uint32_t)msg->queuedAt;
+  memcpy(&buf[0], &msg->key, sizeof(msg->key));
+  memcpy(&buf[4], &queuedAt, sizeof(queuedAt));
+  buf[8] = (uint8_t)msg->priority;
+  memcpy(&buf[SAVED_MSG_HEADER_SIZE], msg->payload, len);
+  return persist_write_data(persistKey, buf, SAVED_MSG_HEADER_SIZE + len) >= 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Saves the messages that the phone has not acknowledged, in sending
+/// order, so that the next launch can resume them. Empties the scheduler;
+/// the messages themselves are left to comm_close().
+/////////////////////////////////////////////////////////////////////////////
+static void saveSendQueue() {
+  if ( (sendScheduler == NULL) || (sendWindow == NULL) ) { return; }
+
+  int32_t qty = 0;
+  void* data = NULL;
+  for (size_t idx=0; RingBuffer_peekAt(sendWindow, idx, &data) == MPA_SUCCESS; idx++) {
+    Message* msg = (Message*) data;
+    if (outlivesLaunch(msg->key, msg->payload) && saveQueuedMsg(msg, SEND_QUEUE_PERSIST_KEY + 1 + qty)) { qty++; }
+  }
+  while (SendScheduler_pop(sendScheduler, &data) == MPA_SUCCESS) {
+    Message* msg = (Message*) data;
+    if (outlivesLaunch(msg->key, msg->payload) && saveQueuedMsg(msg, SEND_QUEUE_PERSIST_KEY + 1 + qty)) { qty++; }
+  }
+
+  if (qty > 0) {
+    persist_write_int(SEND_QUEUE_PERSIST_KEY, qty);
+    APP_LOG(APP_LOG_LEVEL_INFO, "Saved %ld undelivered message(s).", qty);
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Queues the messages saved by the previous launch again, except those
+/// that have expired. They are sent once PebbleKit JS is ready. Saved
+/// messages are deleted as they are read, so they are restored only once.
+/////////////////////////////////////////////////////////////////////////////
+static void restoreSendQueue() {
+  if (!persist_exists(SEND_QUEUE_PERSIST_KEY)) { return; }
+
+  int32_t qty = persist_read_int(SEND_QUEUE_PERSIST_KEY);
+  persist_delete(SEND_QUEUE_PERSIST_KEY);
+  time_t now = time(NULL);
+
+  for (int32_t idx=0; idx<qty; idx++) {
+    uint32_t persistKey = SEND_QUEUE_PERSIST_KEY + 1 + idx;
+    uint8_t buf[PERSIST_DATA_MAX_LENGTH + 1];
+    int len = persist_read_data(persistKey, buf, PERSIST_DATA_MAX_LENGTH);
+    persist_delete(persistKey);
+    if (len < SAVED_MSG_HEADER_SIZE) { continue; }
+
+    uint32_t key = 0;
+    uint32_t queuedAt = 0;
+    memcpy(&key, &buf[0], sizeof(key));
+    memcpy(&queuedAt, &buf[4], sizeof(queuedAt));
+    MsgPriority priority = (MsgPriority) buf[8];
+    buf[len] = '\0';
+
+    if ( !outlivesLaunch(key, (const char*) &buf[SAVED_MSG_HEADER_SIZE]) || (priority >= MSG_PRIORITY_QTY) ) { continue; }
+    if ( ((uint32_t)now < queuedAt) || ((uint32_t)now - queuedAt > SEND_QUEUE_MAX_AGE_S) ) {
+      APP_LOG(APP_LOG_LEVEL_INFO, "Dropping expired message %d.", (int)key);
+      continue;
+    }
+
+    Message* msg = comm_msg_create(key, (const char*) &buf[SAVED_MSG_HEADER_SIZE], priority);
+    if (msg == NULL) { continue; }
+    msg->queuedAt = (time_t) queuedAt;
+    APP_LOG(APP_LOG_LEVEL_INFO, "Restored message %d.", (int)key);
+    comm_enqMsg(msg);
+  }
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 /// Saves app settings to persistent storage.
 /////////////////////////////////////////////////////////////////////////////
@@ -617,10 +1908,15 @@ void comm_savePersistent() {
     switch(keyIdx) {
       case LENDER_ID_STR_SETTING: {
         if (strSettings[keyIdx] != NULL) { free(strSettings[keyIdx]); strSettings[keyIdx] = NULL; }
-        if ( (mpaRet = KivaModel_getLenderId(dataModel, &strSettings[keyIdx])) != MPA_SUCCESS) {
+        char* lenderId = NULL;
+        if ( (mpaRet = KivaModel_getLenderId(dataModel, &lenderId)) != MPA_SUCCESS) {
           APP_LOG(APP_LOG_LEVEL_ERROR, "Could not retrieve lender ID: %s", MagPebApp_getErrMsg(mpaRet));
           return;
         }
+        // The model owns its string; strSettings keeps a copy.
+        if (lenderId == NULL) { lenderId = ""; }
+        if ( (strSettings[keyIdx] = malloc(strlen(lenderId) + 1)) == NULL) { return; }
+        strcpy(strSettings[keyIdx], lenderId);
         break;
       }
     } // end switch(keyIdx)
@@ -674,7 +1970,7 @@ void comm_loadPersistent() {
           if ( (mpaRet = KivaModel_setLenderId(dataModel, strSettings[keyIdx])) != MPA_SUCCESS) {
             APP_LOG(APP_LOG_LEVEL_ERROR, "Error setting %s in data model: %s", "Lender ID", MagPebApp_getErrMsg(mpaRet));
           } else {
-            comm_getLenderInfo();
+            requestLenderInfo(MSG_PRIORITY_PREFETCH);
           }
           break;
         }
@@ -711,9 +2007,13 @@ void comm_tickHandler(struct tm *tick_time, TimeUnits units_changed) {
   }
   (*commHandlers.updateViewClock)(tick_time);
 
-  // Get update every 10 minutes
+  // Get update every 10 minutes, or as soon as the phone is back
   if(tick_time->tm_min % 10 == 0) {
-    comm_getLenderInfo();
+    if (phoneConnected) {
+      requestLenderInfo(MSG_PRIORITY_BACKGROUND);
+    } else {
+      refreshMissed = true;
+    }
   }
 }
 
@@ -730,8 +2030,12 @@ void comm_setHandlers(const CommHandlers cmh) {
 /// Opens communication to PebbleKit and allocates memory.
 /////////////////////////////////////////////////////////////////////////////
 void comm_open() {
+  openedMs = nowMs();
+  firstLoansLogged = false;
   dataModel = NULL;
   if ( (dataModel = KivaModel_create("")) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize data model."); }
+  countryDict = NULL;
+  if ( (countryDict = SessionDict_create(2)) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize country dictionary."); }
   
   strSettings = NULL;
   if ( (strSettings = calloc(LAST_STR_SETTING, sizeof(*strSettings)) ) == NULL) { goto freemem; }
@@ -740,8 +2044,52 @@ void comm_open() {
     strSettings[idx] = NULL;
   }
   
-  sendBuffer = NULL;
-  if ( (sendBuffer = RingBuffer_create(SEND_BUF_SIZE)) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize send buffer."); }
+  sendScheduler = NULL;
+  sendWindow = NULL;
+  sendInFlight = 0;
+  BatchRing_init(&sendBatches);
+  sendRetry = NULL;
+  nextRequestId = 1;
+  for (size_t idx=0; idx<ARRAY_LENGTH(inflightRequests); idx++) {
+    inflightRequests[idx].latestId = 0;
+    inflightRequests[idx].answered = true;
+    LatencyHistogram_init(&inflightRequests[idx].latency);
+  }
+  if ( (sendScheduler = SendScheduler_create(SEND_CLASSES, MSG_PRIORITY_QTY, SEND_AGING_LIMIT)) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize send scheduler."); }
+  if ( (sendWindow = RingBuffer_create(SEND_WINDOW_MSGS)) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize send window."); }
+  if ( (sendRetry = RetryPolicy_create(SEND_RETRY_CLASSES, MSG_PRIORITY_QTY, SEND_RETRY_LIMITS, sendRetryCallback, NULL)) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize send retry policy."); }
+  pebkitReady = false;
+  peerVersion = 0;
+  peerCaps = 0;
+  forgetDataTags();
+  restoreSendQueue();
+  // The saved lender ID is loaded right away, so that its requests go out
+  // with the first dictionary after PEBKIT_READY, next to GET_KIVA_INFO.
+  comm_loadPersistent();
+
+  ingestQueue = NULL;
+  if ( (ingestQueue = WorkQueue_create(INGEST_SLICE_MS, INGEST_YIELD_MS)) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize ingest queue."); }
+  transferSession = NULL;
+  startupHeld = false;
+  if ( (transferSession = TransferSession_create(TRANSFER_IDLE_TIMEOUT_MS, reportTransferSession, NULL)) == NULL) { APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize transfer session."); }
+
+  for (size_t idx=0; idx<ARRAY_LENGTH(inboxRecordSets); idx++) {
+    InboxTransfer* transfer = inboxRecordSets[idx]->transfer;
+    ChunkTracker_init(&transfer->chunks);
+    transfer->syncGen = 0;
+    transfer->pendingGen = 0;
+    transfer->pendingJobs = 0;
+    transfer->rejected = false;
+    transfer->abandoned = false;
+    transfer->finished = false;
+    transfer->resendQty = 0;
+    transfer->resendTimer = NULL;
+    transfer->inSession = false;
+  }
+
+  phoneConnected = connection_service_peek_pebble_app_connection();
+  refreshMissed = false;
+  connection_service_subscribe((ConnectionHandlers) { .pebble_app_connection_handler = appConnectionHandler });
 
   // Register callbacks
   app_message_register_inbox_received(inbox_received_callback);
@@ -750,7 +2098,9 @@ void comm_open() {
   app_message_register_outbox_sent(outbox_sent_callback);
 
   // Open AppMessage
-  app_message_open(app_message_inbox_size_maximum(), 300);
+  inboxSize = app_message_inbox_size_maximum();
+  chunkSize = inboxSize;
+  app_message_open(inboxSize, OUTBOX_SIZE);
   
   return;
   
@@ -764,12 +2114,42 @@ freemem:
 /// Closes communication and frees memory.
 /////////////////////////////////////////////////////////////////////////////
 void comm_close() {
+  // Unfinished ingest jobs point into model-owned buffers, so they go first.
+  if (ingestQueue != NULL) {
+    WorkQueue_destroy(ingestQueue);  ingestQueue = NULL;
+  }
+
+  for (size_t idx=0; idx<ARRAY_LENGTH(inboxRecordSets); idx++) {
+    InboxTransfer* transfer = inboxRecordSets[idx]->transfer;
+    if (transfer->resendTimer != NULL) { app_timer_cancel(transfer->resendTimer);  transfer->resendTimer = NULL; }
+    ChunkTracker_reset(&transfer->chunks);
+    transfer->inSession = false;
+  }
+  // Gives the radio back if a session is still open.
+  if (transferSession != NULL) {
+    TransferSession_destroy(transferSession);  transferSession = NULL;
+  }
+
   if (dataModel != NULL) {
     KivaModel_destroy(dataModel);  dataModel = NULL;
   }
+  if (countryDict != NULL) {
+    SessionDict_destroy(countryDict);  countryDict = NULL;
+  }
   
-  if (sendBuffer != NULL) {
-    RingBuffer_destroy(sendBuffer);  sendBuffer = NULL;
+  // Whatever the phone has not acknowledged is resumed by the next launch.
+  saveSendQueue();
+  if (sendRetry != NULL) {
+    RetryPolicy_destroy(sendRetry);  sendRetry = NULL;
+  }
+  if (sendScheduler != NULL) {
+    SendScheduler_destroy(sendScheduler);  sendScheduler = NULL;
+  }
+  if (sendWindow != NULL) {
+    RingBuffer_destroy(sendWindow);  sendWindow = NULL;
+  }
+  for (size_t idx=0; idx<ARRAY_LENGTH(sendSlots); idx++) {
+    if (sendSlots[idx].inUse) { comm_msg_destroy(&sendSlots[idx]); }
   }
   
   if (strSettings != NULL) {
@@ -779,6 +2159,7 @@ void comm_close() {
     if (strSettings != NULL) { free(strSettings); strSettings = NULL; }
   }
   
+  connection_service_unsubscribe();
   app_message_deregister_callbacks();
 }
 
@@ -15,9 +15,29 @@ typedef enum StrSettings {
 } StrSettings;
 
 
+// Outbound messages are scheduled by priority class; lower values go first.
+typedef enum MsgPriority {
+  MSG_PRIORITY_INTERACTIVE = 0,   ///< requested by the user, or completing data the user is waiting for
+  MSG_PRIORITY_PREFETCH,          ///< follow-up requests while the app loads its data
+  MSG_PRIORITY_BACKGROUND,        ///< periodic refreshes
+
+  MSG_PRIORITY_QTY
+} MsgPriority;
+
+
+// Payloads up to this size (including the terminator) are stored inside
+// the message itself; longer ones are copied to the heap.
+#define MSG_INLINE_PAYLOAD_SIZE 32
+
+
 typedef struct Message {
-  uint32_t  key;
-  char*     payload;
+  uint32_t     key;
+  char*        payload;         ///< owned copy; points to inlinePayload when it fits
+  MsgPriority  priority;
+  uint8_t      attempts;        ///< retries made so far
+  time_t       queuedAt;        ///< when the message was created; restored messages expire by it
+  bool         inUse;           ///< the slot holds a message
+  char         inlinePayload[MSG_INLINE_PAYLOAD_SIZE];
 } Message;
 
 
@@ -45,9 +65,6 @@ void comm_enqMsg(Message*);
 void comm_sendBufMsg();
 void comm_startResendTimer();
 
-// For unbuffered sending
-void comm_sendMsg(const Message*);
-
 void comm_tickHandler(struct tm *tick_time, TimeUnits units_changed);
 void comm_setHandlers(const CommHandlers);
 
@@ -98,7 +98,7 @@ static MagPebApp_ErrCode KivaModel_LoanRec_create(LoanRec** loan) {
   if (*loan == NULL) { goto freemem; }
   (*loan)->data.name = NULL;
   (*loan)->data.use = NULL;
-  (*loan)->data.countryCode = NULL;
+  (*loan)->buf = NULL;
 
   return MPA_SUCCESS;
 
@@ -111,10 +111,11 @@ freemem:
 /////////////////////////////////////////////////////////////////////////////
 /// Initializes a LoanRec pointer and its members.
 /// @param[in,out]  this  Pointer to LoanRec; must be already
-///       allocated upon entry, but heap-allocated members must be NULL
-/// @param[in]      loanInfo  A fully initialized LoanInfo variable. All heap-
-///       allocated members are expected to be non-NULL, allocated and
-///       populated with data.
+///       allocated upon entry, but string members must be NULL
+/// @param[in]      loanInfo  A fully initialized LoanInfo variable. The
+///       name and use members are expected to be non-NULL and to point into
+///       a PayloadBuf owned by this KivaModel's current generation. Those
+///       strings are borrowed, not copied.
 /////////////////////////////////////////////////////////////////////////////
 static MagPebApp_ErrCode KivaModel_LoanRec_init(LoanRec* this, const LoanInfo loanInfo) {
   MPA_RETURN_IF_NULL(this);
@@ -126,44 +127,26 @@ static MagPebApp_ErrCode KivaModel_LoanRec_init(LoanRec* this, const LoanInfo lo
     APP_LOG(APP_LOG_LEVEL_ERROR, "LoanRec use must be NULL.");
     return MPA_INVALID_INPUT_ERR;
   }
-  if (this->data.countryCode != NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "LoanRec country code must be NULL.");
+  if ( (loanInfo.name == NULL) || (loanInfo.use == NULL) ) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Init parameter loanInfo strings must not be NULL.");
     return MPA_INVALID_INPUT_ERR;
   }
 
-  if ( (this->data.name = malloc(strlen(loanInfo.name) + 1)) == NULL) { goto freemem; }
-  strcpy(this->data.name, loanInfo.name);
-
-  if ( (this->data.use = malloc(strlen(loanInfo.use) + 1)) == NULL) { goto freemem; }
-  strcpy(this->data.use, loanInfo.use);
-
-  if ( (this->data.countryCode = malloc(strlen(loanInfo.countryCode) + 1)) == NULL) { goto freemem; }
-  strcpy(this->data.countryCode, loanInfo.countryCode);
-
-  this->data.id = loanInfo.id;
-  this->data.fundedAmt = loanInfo.fundedAmt;
-  this->data.loanAmt = loanInfo.loanAmt;
+  this->data = loanInfo;
 
   return MPA_SUCCESS;
-
-freemem:
-  if (this->data.name != NULL) { free(this->data.name); this->data.name = NULL; }
-  if (this->data.use != NULL) { free(this->data.use);   this->data.use = NULL; }
-  if (this->data.countryCode != NULL) { free(this->data.countryCode);   this->data.countryCode = NULL; }
-  return MPA_OUT_OF_MEMORY_ERR;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Frees all memory associated with a LoanRec pointer.
+/// Frees all memory associated with a LoanRec pointer. The strings it
+/// borrows are released along with their PayloadBuf (see
+/// KivaModel_unrefPayloadBuf()).
 /// @param[in,out]  this  Pointer to LoanRec; must be already allocated
 /////////////////////////////////////////////////////////////////////////////
 static MagPebApp_ErrCode KivaModel_LoanRec_destroy(LoanRec* this) {
   MPA_RETURN_IF_NULL(this);
   //HEAP_LOG("Freeing LoanRec");
-  if (this->data.name != NULL) { free(this->data.name); this->data.name = NULL; }
-  if (this->data.use != NULL) { free(this->data.use); this->data.use = NULL; }
-  if (this->data.countryCode != NULL) { free(this->data.countryCode); this->data.countryCode = NULL; }
   free(this); this = NULL;
   return MPA_SUCCESS;
 }
@@ -209,10 +192,10 @@ MagPebApp_ErrCode KivaModel_destroy(KivaModel* this) {
   // Free memory for this->kivaCountries and its data
   CountryRec* cntry = NULL; CountryRec* tmpCntry = NULL;
   HASH_ITER(hh, this->kivaCountries, cntry, tmpCntry) {
+    HASH_DEL(this->kivaCountries, cntry);
     if ( (mpaRet = KivaModel_CountryRec_destroy(cntry)) != MPA_SUCCESS) {
       APP_LOG(APP_LOG_LEVEL_ERROR, "Error destroying: %s", MagPebApp_getErrMsg(mpaRet));
     }
-    HASH_DEL(this->kivaCountries, cntry);
     cntry = NULL;
   }
 
@@ -249,10 +232,11 @@ MagPebApp_ErrCode KivaModel_init(KivaModel* this, const char* lenderId) {
   this->lenderInfo.loc = NULL;
   this->lenderInfo.loanQty = 0;
 
-  if ( (mpaRet = KivaModel_setLenderId(this, lenderId)) != MPA_SUCCESS) { goto freemem; }
-
   this->kivaCountries = NULL;
   this->prefLoans = NULL;
+  this->prefLoanBufs = NULL;
+
+  if ( (mpaRet = KivaModel_setLenderId(this, lenderId)) != MPA_SUCCESS) { goto freemem; }
 
   return MPA_SUCCESS;
 
@@ -433,6 +417,45 @@ MagPebApp_ErrCode KivaModel_addLenderCountry(KivaModel* this, const char* countr
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+/// Removes a country ID from the list of countries supported by the
+/// lender. The country itself stays in the list of recognized countries.
+/// @param[in,out]  this  Pointer to KivaModel; must be already allocated
+/// @param[in]      countryId  ID of the country to remove; a two-character
+///       ISO-3361 country code. Unknown IDs are ignored.
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode KivaModel_removeLenderCountry(KivaModel* this, const char* countryId) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(this->mods);
+  MPA_RETURN_IF_NULL(countryId);
+
+  CountryRec *cntry = NULL;
+  HASH_FIND_STR(this->kivaCountries, countryId, cntry);
+  if ( (cntry != NULL) && cntry->lenderSupport ) {
+    cntry->lenderSupport = false;
+    this->mods->lenderCountryQty = 1;
+  }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Empties the list of countries supported by the lender.
+/// @param[in,out]  this  Pointer to KivaModel; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode KivaModel_clearLenderCountries(KivaModel* this) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(this->mods);
+
+  CountryRec* cntry = NULL;
+  for (cntry=this->kivaCountries; cntry!=NULL; cntry=cntry->hh.next) {
+    cntry->lenderSupport = false;
+  }
+  this->mods->lenderCountryQty = 1;
+  return MPA_SUCCESS;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 /// Gets the currently-stored lender ID.
 /// @param[in,out]  this  Pointer to KivaModel; must be already allocated
@@ -613,9 +636,42 @@ freemem:
 
 
 
+/////////////////////////////////////////////////////////////////////////////
+/// Drops one reference to a PayloadBuf of the current generation, and
+/// frees it once nothing refers to it any more, so that the strings of
+/// replaced and removed loans do not outlive them until the next full
+/// generation.
+/// @param[in,out]  this  Pointer to KivaModel; must be already allocated
+/// @param[in]      buf  PayloadBuf to release; NULL is ignored
+/////////////////////////////////////////////////////////////////////////////
+static void KivaModel_unrefPayloadBuf(KivaModel* this, PayloadBuf* buf) {
+  if ( (buf == NULL) || (--buf->refQty > 0) ) { return; }
+
+  for (PayloadBuf** link = &this->prefLoanBufs; *link != NULL; link = &(*link)->next) {
+    if (*link == buf) {
+      *link = buf->next;
+      free(buf);
+      return;
+    }
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Removes a loan record from the list of preferred loans and frees it,
+/// along with its PayloadBuf if no other record borrows from that.
+/////////////////////////////////////////////////////////////////////////////
+static void KivaModel_dropPrefLoan(KivaModel* this, LoanRec* loanRec) {
+  HASH_DEL(this->prefLoans, loanRec);
+  KivaModel_unrefPayloadBuf(this, loanRec->buf);
+  KivaModel_LoanRec_destroy(loanRec);
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 /// Clears the list of preferred loans, freeing all heap-allocated members
-/// of LoanInfo data.
+/// of LoanInfo data. This drops the current generation, including every
+/// PayloadBuf that backed its strings.
 /// Preferred loans are a list of fundraising loans in which the lender has
 /// indicated an interest.
 /// @param[in,out]  this  Pointer to KivaModel; must be already allocated
@@ -627,18 +683,78 @@ MagPebApp_ErrCode KivaModel_clearPreferredLoans(KivaModel* this) {
 
   LoanRec* loanRec = NULL; LoanRec* tmpLoan = NULL;
   HASH_ITER(hh, this->prefLoans, loanRec, tmpLoan) {
+    HASH_DEL(this->prefLoans, loanRec);
     if ( (mpaRet = KivaModel_LoanRec_destroy(loanRec)) != MPA_SUCCESS) {
       APP_LOG(APP_LOG_LEVEL_ERROR, "Error destroying: %s", MagPebApp_getErrMsg(mpaRet));
     }
-    HASH_DEL(this->prefLoans, loanRec);
     loanRec = NULL;
   }
+
+  while (this->prefLoanBufs != NULL) {
+    PayloadBuf* next = this->prefLoanBufs->next;
+    free(this->prefLoanBufs);
+    this->prefLoanBufs = next;
+  }
   this->mods->preferredLoanQty = 1;
 
   return MPA_SUCCESS;
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+/// Allocates storage that belongs to the current generation of preferred
+/// loans. Decoders copy an incoming payload here once and then add records
+/// with KivaModel_addPreferredLoanRef() whose strings point into it.
+/// @param[in,out]  this  Pointer to KivaModel; must be already allocated
+/// @param[in]      size  Number of bytes required
+/// @param[out]     buf  Pointer to the new storage; must be NULL on entry.
+///       <em>Ownership is not transferred to the caller, who must call
+///       KivaModel_releasePrefLoanBuf() once every record has been added.
+///       The storage is freed after that, as soon as no preferred loan
+///       borrows from it, or by KivaModel_clearPreferredLoans() or
+///       KivaModel_destroy().</em>
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_INVALID_INPUT_ERR if buf is not NULL on entry
+///          MPA_OUT_OF_MEMORY_ERR if a memory allocation fails
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode KivaModel_allocPrefLoanBuf(KivaModel* this, const size_t size, char** buf) {
+  MPA_RETURN_IF_NULL(this);
+  if (*buf != NULL) { return MPA_INVALID_INPUT_ERR; }
+
+  PayloadBuf* payloadBuf = malloc(sizeof(*payloadBuf) + size);
+  if (payloadBuf == NULL) { return MPA_OUT_OF_MEMORY_ERR; }
+
+  payloadBuf->next = this->prefLoanBufs;
+  payloadBuf->size = size;
+  payloadBuf->refQty = 1;
+  this->prefLoanBufs = payloadBuf;
+  *buf = payloadBuf->data;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Ends writing to storage from KivaModel_allocPrefLoanBuf(): it is freed
+/// now if no preferred loan borrows from it, or else once none does.
+/// Storage that KivaModel_clearPreferredLoans() has already freed is
+/// ignored.
+/// @param[in,out]  this  Pointer to KivaModel; must be already allocated
+/// @param[in]      buf  Pointer returned by KivaModel_allocPrefLoanBuf()
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode KivaModel_releasePrefLoanBuf(KivaModel* this, const char* buf) {
+  MPA_RETURN_IF_NULL(this);
+
+  for (PayloadBuf* payloadBuf = this->prefLoanBufs; payloadBuf != NULL; payloadBuf = payloadBuf->next) {
+    if (payloadBuf->data == buf) {
+      KivaModel_unrefPayloadBuf(this, payloadBuf);
+      break;
+    }
+  }
+  return MPA_SUCCESS;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 /// Returns the number of preferred loans stored in this model.
 ///
@@ -682,6 +798,44 @@ MagPebApp_ErrCode KivaModel_addPreferredLoan(KivaModel* this, const LoanInfo loa
   MPA_RETURN_IF_NULL(this);
   MagPebApp_ErrCode mpaRet;
 
+  if ( (loanInfo.name == NULL) || (loanInfo.use == NULL) ) {
+    return MPA_INVALID_INPUT_ERR;
+  }
+
+  size_t nameSize = strlen(loanInfo.name) + 1;
+  size_t useSize = strlen(loanInfo.use) + 1;
+  char* buf = NULL;
+  if ( (mpaRet = KivaModel_allocPrefLoanBuf(this, nameSize + useSize, &buf)) != MPA_SUCCESS) {
+    return mpaRet;
+  }
+
+  LoanInfo copy = loanInfo;
+  copy.name = memcpy(buf, loanInfo.name, nameSize);
+  copy.use = memcpy(buf + nameSize, loanInfo.use, useSize);
+
+  mpaRet = KivaModel_addPreferredLoanRef(this, copy);
+  KivaModel_releasePrefLoanBuf(this, buf);
+  return mpaRet;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Adds a new loan to the list of preferred loans without copying its
+/// strings. If a loan with the same ID is already in the list, it is
+/// replaced.
+/// @param[in,out]  this  Pointer to KivaModel; must be already allocated
+/// @param[in]      loanInfo  information about the preferred loan. The string
+///       members must point into storage obtained from
+///       KivaModel_allocPrefLoanBuf() since the last call to
+///       KivaModel_clearPreferredLoans(). <em>The record borrows those
+///       strings, and holds their storage until it is replaced, removed or
+///       dropped with its generation.</em>
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode KivaModel_addPreferredLoanRef(KivaModel* this, const LoanInfo loanInfo) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(this->mods);
+  MagPebApp_ErrCode mpaRet;
+
   LoanRec *newLoanRec = NULL;
   if ( (mpaRet = KivaModel_LoanRec_create(&newLoanRec)) != MPA_SUCCESS) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Could not create (%ld): %s", loanInfo.id, MagPebApp_getErrMsg(mpaRet));
@@ -693,6 +847,14 @@ MagPebApp_ErrCode KivaModel_addPreferredLoan(KivaModel* this, const LoanInfo loa
     return mpaRet;
   }
 
+  for (PayloadBuf* buf = this->prefLoanBufs; buf != NULL; buf = buf->next) {
+    if ( (loanInfo.name >= buf->data) && (loanInfo.name < buf->data + buf->size) ) {
+      newLoanRec->buf = buf;
+      buf->refQty++;
+      break;
+    }
+  }
+
   LoanRec *loanRec = NULL;
   HASH_FIND_INT(this->prefLoans, &loanInfo.id, loanRec);
 
@@ -703,8 +865,7 @@ MagPebApp_ErrCode KivaModel_addPreferredLoan(KivaModel* this, const LoanInfo loa
   } else {
     // Value of loanInfo.id was already a key in the hash table; replace it.
     HASH_ADD_INT(this->prefLoans, data.id, newLoanRec);
-    HASH_DEL(this->prefLoans, loanRec);
-    if (loanRec != NULL) { KivaModel_LoanRec_destroy(loanRec);  loanRec = NULL; }
+    if (loanRec != NULL) { KivaModel_dropPrefLoan(this, loanRec);  loanRec = NULL; }
     else {
       APP_LOG(APP_LOG_LEVEL_WARNING, "This shouldn't happen. The LoanRec we just found (%ld) is no longer in the hash.", loanInfo.id);
     }
@@ -714,6 +875,27 @@ MagPebApp_ErrCode KivaModel_addPreferredLoan(KivaModel* this, const LoanInfo loa
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+/// Removes a loan from the list of preferred loans, and frees the storage
+/// of its strings if no other loan borrows from it.
+/// @param[in,out]  this  Pointer to KivaModel; must be already allocated
+/// @param[in]      loanId  ID of the loan to remove. Unknown IDs are
+///       ignored.
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode KivaModel_removePreferredLoan(KivaModel* this, const uint32_t loanId) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(this->mods);
+
+  LoanRec *loanRec = NULL;
+  HASH_FIND_INT(this->prefLoans, &loanId, loanRec);
+  if (loanRec != NULL) {
+    KivaModel_dropPrefLoan(this, loanRec);  loanRec = NULL;
+    this->mods->preferredLoanQty = 1;
+  }
+  return MPA_SUCCESS;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 /// Used to iterate through the list of preferred loans.
 ///
@@ -831,6 +1013,8 @@ MagPebApp_ErrCode KivaModel_addKivaCountry(KivaModel* this, const char* countryI
     this->mods->kivaCountryQty = 1;
   } else {
     // Value of countryId was already a key in the hash table; replace it.
+    // Lender data may have arrived first, so the lender's support is kept.
+    newCntry->lenderSupport = cntry->lenderSupport;
     HASH_ADD_KEYPTR(hh, this->kivaCountries, newCntry->id, strlen(newCntry->id), newCntry);
     HASH_DEL(this->kivaCountries, cntry);
     if (cntry != NULL) { KivaModel_CountryRec_destroy(cntry);  cntry = NULL; }
@@ -12,7 +12,7 @@ typedef struct LoanInfo {
   uint32_t id;              ///< numeric loan ID
   char*    name;            ///< the name of the loan (generally the individual or group receiving the loan)
   char*    use;             ///< description of how the loan will be used
-  char*    countryCode;     ///< the two-character ISO-3361 code
+  char     countryCode[3];  ///< the two-character ISO-3361 code
   uint16_t fundedAmt;       ///< amount (USD) of funding received by the loan
   uint16_t loanAmt;         ///< amount (USD) requested for the loan
 } LoanInfo;
@@ -43,9 +43,15 @@ MagPebApp_ErrCode KivaModel_setLenderLoc(KivaModel* this, const char*);
 MagPebApp_ErrCode KivaModel_setLenderLoanQty(KivaModel* this, const int);
 
 MagPebApp_ErrCode KivaModel_addLenderCountry(KivaModel* this, const char*, const char*);
+MagPebApp_ErrCode KivaModel_removeLenderCountry(KivaModel* this, const char*);
+MagPebApp_ErrCode KivaModel_clearLenderCountries(KivaModel* this);
 MagPebApp_ErrCode KivaModel_addKivaCountry(KivaModel* this, const char*, const char*);
 
 MagPebApp_ErrCode KivaModel_addPreferredLoan(KivaModel* this, const LoanInfo);
+MagPebApp_ErrCode KivaModel_addPreferredLoanRef(KivaModel* this, const LoanInfo);
+MagPebApp_ErrCode KivaModel_removePreferredLoan(KivaModel* this, const uint32_t);
+MagPebApp_ErrCode KivaModel_allocPrefLoanBuf(KivaModel* this, const size_t, char**);
+MagPebApp_ErrCode KivaModel_releasePrefLoanBuf(KivaModel* this, const char*);
 MagPebApp_ErrCode KivaModel_clearPreferredLoans(KivaModel* this);
 
 // Getters
@@ -20,8 +20,17 @@ typedef struct CountryRec {
 } CountryRec;
 
 
+typedef struct PayloadBuf {
+  struct PayloadBuf* next;  ///< next buffer belonging to the same generation
+  size_t size;              ///< bytes of data
+  uint16_t refQty;          ///< records borrowing from data, plus one until the writer releases it
+  char data[];              ///< payload storage; records borrow their strings from here
+} PayloadBuf;
+
+
 typedef struct LoanRec {
-  LoanInfo data;
+  LoanInfo data;            ///< string members point into a PayloadBuf of the current generation
+  PayloadBuf* buf;          ///< the PayloadBuf that data borrows from; NULL if none
   UT_hash_handle hh;
 } LoanRec;
 
@@ -32,6 +41,7 @@ struct KivaModel {
   struct LenderInfo lenderInfo;
   CountryRec* kivaCountries;
   LoanRec* prefLoans;
+  PayloadBuf* prefLoanBufs; ///< storage backing the current generation of preferred loans
 
   KivaModel_Modified* mods;
 };
@@ -0,0 +1,113 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "ChunkTracker.h"
+
+
+#define CHUNK_TRACKER_HAS(CT, SEQ) ((CT)->received[(SEQ) >> 3] & (1 << ((SEQ) & 7)))
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Initializes an idle ChunkTracker.
+/// @param[in,out]  this  Pointer to ChunkTracker; may be statically allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode ChunkTracker_init(ChunkTracker* this) {
+  MPA_RETURN_IF_NULL(this);
+
+  this->transferId = 0;
+  this->chunkQty = 0;
+  this->receivedQty = 0;
+  this->received = NULL;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Forgets the current transfer and frees the memory it used.
+/// @param[in,out]  this  Pointer to an initialized ChunkTracker
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode ChunkTracker_reset(ChunkTracker* this) {
+  MPA_RETURN_IF_NULL(this);
+
+  if (this->received != NULL) { free(this->received);  this->received = NULL; }
+  return ChunkTracker_init(this);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Starts tracking a new transfer, forgetting the previous one.
+/// @param[in,out]  this  Pointer to an initialized ChunkTracker
+/// @param[in]      transferId  Identifies the transfer
+/// @param[in]      chunkQty  Number of chunks the transfer is split into
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_INVALID_INPUT_ERR if chunkQty is zero
+///          MPA_OUT_OF_MEMORY_ERR if a memory allocation fails
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode ChunkTracker_begin(ChunkTracker* this, uint32_t transferId, uint16_t chunkQty) {
+  MPA_RETURN_IF_NULL(this);
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+
+  if ( (mpaRet = ChunkTracker_reset(this)) != MPA_SUCCESS) { return mpaRet; }
+  if (chunkQty == 0) { return MPA_INVALID_INPUT_ERR; }
+
+  if ( (this->received = calloc((chunkQty + 7) / 8, sizeof(*this->received))) == NULL) { return MPA_OUT_OF_MEMORY_ERR; }
+  this->transferId = transferId;
+  this->chunkQty = chunkQty;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Tracking transfer %ld [%d chunks]", transferId, chunkQty);
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Records the arrival of a chunk.
+/// @param[in,out]  this  Pointer to a ChunkTracker with a transfer begun
+/// @param[in]      seq  Sequence number of the chunk, in [0 .. chunkQty-1]
+/// @param[out]     isNew  Set to false if this chunk had already arrived
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_INVALID_INPUT_ERR if seq is out of range for the transfer
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode ChunkTracker_mark(ChunkTracker* this, uint16_t seq, bool* isNew) {
+  MPA_RETURN_IF_NULL(this);
+  if ( (this->received == NULL) || (seq >= this->chunkQty) ) { return MPA_INVALID_INPUT_ERR; }
+
+  *isNew = !CHUNK_TRACKER_HAS(this, seq);
+  if (*isNew) {
+    this->received[seq >> 3] |= (1 << (seq & 7));
+    this->receivedQty++;
+  }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether every chunk of the current transfer has arrived.
+/////////////////////////////////////////////////////////////////////////////
+bool ChunkTracker_complete(const ChunkTracker* this) {
+  return (this != NULL) && (this->chunkQty != 0) && (this->receivedQty == this->chunkQty);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Lists the sequence numbers of chunks that have not arrived yet.
+/// @param[in]      this  Pointer to an initialized ChunkTracker
+/// @param[out]     seqs  Receives the missing sequence numbers, lowest first
+/// @param[in]      maxQty  Capacity of seqs
+/// @param[out]     qty  Receives the number of entries written to seqs
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode ChunkTracker_getMissing(const ChunkTracker* this, uint16_t* seqs, uint16_t maxQty, uint16_t* qty) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(seqs);
+
+  *qty = 0;
+  for (uint16_t seq = 0; (seq < this->chunkQty) && (*qty < maxQty); seq++) {
+    if (!CHUNK_TRACKER_HAS(this, seq)) { seqs[(*qty)++] = seq; }
+  }
+  return MPA_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+// Tracks which sequenced chunks of a transfer have arrived. A plain struct
+// so that it can be embedded in whatever owns the transfer; only the
+// bitmap of received chunks is heap-allocated.
+typedef struct ChunkTracker {
+  uint32_t transferId;      ///< transfer being tracked (as chosen by the sender)
+  uint16_t chunkQty;        ///< number of chunks in the transfer; 0 when idle
+  uint16_t receivedQty;     ///< number of distinct chunks received so far
+  uint8_t* received;        ///< bitmap of received chunk sequence numbers
+} ChunkTracker;
+
+
+MagPebApp_ErrCode ChunkTracker_init(ChunkTracker* this);
+MagPebApp_ErrCode ChunkTracker_reset(ChunkTracker* this);
+
+MagPebApp_ErrCode ChunkTracker_begin(ChunkTracker* this, uint32_t transferId, uint16_t chunkQty);
+MagPebApp_ErrCode ChunkTracker_mark(ChunkTracker* this, uint16_t seq, bool* isNew);
+
+bool ChunkTracker_complete(const ChunkTracker* this);
+MagPebApp_ErrCode ChunkTracker_getMissing(const ChunkTracker* this, uint16_t* seqs, uint16_t maxQty, uint16_t* qty);
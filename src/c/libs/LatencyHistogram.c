@@ -0,0 +1,73 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "LatencyHistogram.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Initializes an empty LatencyHistogram.
+/// @param[in,out]  this  Pointer to LatencyHistogram; may be statically
+///       allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode LatencyHistogram_init(LatencyHistogram* this) {
+  MPA_RETURN_IF_NULL(this);
+
+  memset(this->counts, 0, sizeof(this->counts));
+  this->total = 0;
+  this->maxMs = 0;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Adds one sample. Counts saturate rather than wrap.
+/// @param[in,out]  this  Pointer to an initialized LatencyHistogram
+/// @param[in]      ms  Latency of the sample
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode LatencyHistogram_record(LatencyHistogram* this, uint32_t ms) {
+  MPA_RETURN_IF_NULL(this);
+
+  uint8_t bucket = 0;
+  while ( (bucket < LATENCY_BUCKET_QTY - 1) && (ms >= ((uint32_t)LATENCY_BUCKET_BASE_MS << bucket)) ) { bucket++; }
+
+  if (this->counts[bucket] < UINT16_MAX) { this->counts[bucket]++; }
+  if (this->total < UINT16_MAX) { this->total++; }
+  if (ms > this->maxMs) { this->maxMs = ms; }
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "LatencyHistogram %ld ms -> bucket %d", ms, bucket);
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Estimates a percentile as the upper bound of the bucket it falls in
+/// (the slowest sample, for the open-ended bucket).
+/// @param[in]      this  Pointer to an initialized LatencyHistogram
+/// @param[in]      pct  Percentile, 1 to 100
+/// @param[out]     ms  Estimated latency; 0 if nothing was recorded
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this or ms is NULL
+///          MPA_INVALID_INPUT_ERR if pct is out of range
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode LatencyHistogram_percentile(const LatencyHistogram* this, uint8_t pct, uint32_t* ms) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(ms);
+  if ( (pct == 0) || (pct > 100) ) { return MPA_INVALID_INPUT_ERR; }
+
+  *ms = 0;
+  if (this->total == 0) { return MPA_SUCCESS; }
+
+  uint32_t rank = ((uint32_t)this->total * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t bucket=0; bucket<LATENCY_BUCKET_QTY; bucket++) {
+    seen += this->counts[bucket];
+    if (seen >= rank) {
+      *ms = (bucket < LATENCY_BUCKET_QTY - 1) ? ((uint32_t)LATENCY_BUCKET_BASE_MS << bucket) : this->maxMs;
+      break;
+    }
+  }
+  return MPA_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+// Bucket b counts latencies below (LATENCY_BUCKET_BASE_MS << b); the last
+// bucket is open-ended.
+#define LATENCY_BUCKET_QTY 8
+#define LATENCY_BUCKET_BASE_MS 125
+
+
+// A small log-scale histogram of round-trip times. A plain struct so that
+// it can be embedded in whatever it measures.
+typedef struct LatencyHistogram {
+  uint16_t counts[LATENCY_BUCKET_QTY];
+  uint16_t total;           ///< samples recorded
+  uint32_t maxMs;           ///< slowest sample
+} LatencyHistogram;
+
+
+MagPebApp_ErrCode LatencyHistogram_init(LatencyHistogram* this);
+MagPebApp_ErrCode LatencyHistogram_record(LatencyHistogram* this, uint32_t ms);
+MagPebApp_ErrCode LatencyHistogram_percentile(const LatencyHistogram* this, uint8_t pct, uint32_t* ms);
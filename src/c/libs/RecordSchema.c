@@ -0,0 +1,254 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+//#undef APP_LOG
+//#define APP_LOG(...)
+
+#include "RecordSchema.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Decodes one field of the specified type from the tokenizer.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode RecordSchema_decodeField(Tokenizer* tok, const RecordFieldType type, RecordValue* value) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  char* str = NULL;
+
+  switch (type) {
+    case RF_U32:
+      return Tokenizer_nextUInt32(tok, &value->u32);
+    case RF_U16:
+      return Tokenizer_nextUInt16(tok, &value->u16);
+    case RF_STR:
+      return Tokenizer_nextStr(tok, &value->str);
+    case RF_CC:
+      if ( (mpaRet = Tokenizer_nextStr(tok, &str)) != MPA_SUCCESS) { return mpaRet; }
+      if ( (str[0] == '\0') || (str[1] == '\0') || (str[2] != '\0') ) {
+        return MPA_INVALID_INPUT_ERR;
+      }
+      memcpy(value->cc, str, sizeof(value->cc));
+      return MPA_SUCCESS;
+    case RF_U8:
+      if ( (mpaRet = Tokenizer_nextUInt16(tok, &value->u16)) != MPA_SUCCESS) { return mpaRet; }
+      if (value->u16 > UINT8_MAX) { return MPA_OVERFLOW_ERR; }
+      value->u8 = (uint8_t) value->u16;
+      return MPA_SUCCESS;
+    default:
+      return MPA_INVALID_INPUT_ERR;
+  } // end switch
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Decodes one field of the specified type from a binary record, advancing
+/// pos past it. A string is moved one byte to the left, over its own length
+/// prefix, which leaves room to null-terminate it in place.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode RecordSchema_decodeBinaryField(uint8_t** pos, const uint8_t* recEnd, const RecordFieldType type,
+                                                        RecordValue* value) {
+  uint8_t* p = *pos;
+  size_t avail = recEnd - p;
+
+  switch (type) {
+    case RF_U32:
+      if (avail < 4) { return MPA_INVALID_INPUT_ERR; }
+      value->u32 = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+      *pos = p + 4;
+      return MPA_SUCCESS;
+    case RF_U16:
+      if (avail < 2) { return MPA_INVALID_INPUT_ERR; }
+      value->u16 = (uint16_t)(p[0] | (p[1] << 8));
+      *pos = p + 2;
+      return MPA_SUCCESS;
+    case RF_STR:
+      if ( (avail < 1) || (avail < 1 + (size_t)p[0]) ) { return MPA_INVALID_INPUT_ERR; }
+      avail = p[0];
+      memmove(p, p + 1, avail);
+      p[avail] = '\0';
+      value->str = (char*) p;
+      *pos = p + avail + 1;
+      return MPA_SUCCESS;
+    case RF_CC:
+      if ( (avail < 2) || (p[0] == '\0') || (p[1] == '\0') ) { return MPA_INVALID_INPUT_ERR; }
+      value->cc[0] = (char) p[0];
+      value->cc[1] = (char) p[1];
+      value->cc[2] = '\0';
+      *pos = p + 2;
+      return MPA_SUCCESS;
+    case RF_U8:
+      if (avail < 1) { return MPA_INVALID_INPUT_ERR; }
+      value->u8 = p[0];
+      *pos = p + 1;
+      return MPA_SUCCESS;
+    default:
+      return MPA_INVALID_INPUT_ERR;
+  } // end switch
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Decodes the next text record into values.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode RecordDecoder_decodeText(RecordDecoder* this, RecordValue* values, uint8_t* fieldIdx) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+
+  for (*fieldIdx = 0; *fieldIdx < this->schema->numFields; (*fieldIdx)++) {
+    if ( (mpaRet = RecordSchema_decodeField(&this->tok, this->schema->fields[*fieldIdx], &values[*fieldIdx])) != MPA_SUCCESS) {
+      return (mpaRet == MPA_EMPTY_ERR) ? MPA_INVALID_INPUT_ERR : mpaRet;
+    }
+  }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Decodes the next binary record into values.
+/////////////////////////////////////////////////////////////////////////////
+static MagPebApp_ErrCode RecordDecoder_decodeBinary(RecordDecoder* this, RecordValue* values, uint8_t* fieldIdx) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  uint8_t* p = this->bin.pos;
+
+  *fieldIdx = 0;
+  if (this->bin.end - p < 2) { return MPA_INVALID_INPUT_ERR; }
+  uint16_t recLen = (uint16_t)(p[0] | (p[1] << 8));
+  p += 2;
+  if ((size_t)(this->bin.end - p) < recLen) { return MPA_INVALID_INPUT_ERR; }
+  const uint8_t* recEnd = p + recLen;
+
+  for (; *fieldIdx < this->schema->numFields; (*fieldIdx)++) {
+    if ( (mpaRet = RecordSchema_decodeBinaryField(&p, recEnd, this->schema->fields[*fieldIdx], &values[*fieldIdx])) != MPA_SUCCESS) {
+      return mpaRet;
+    }
+  }
+
+  this->bin.pos = (recEnd == this->bin.end) ? NULL : (uint8_t*) recEnd;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether every record of the payload has been consumed.
+/////////////////////////////////////////////////////////////////////////////
+static bool RecordDecoder_done(const RecordDecoder* this) {
+  return this->binary ? (this->bin.pos == NULL) : Tokenizer_done(&this->tok);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Prepares to decode a delimited set of records according to a schema.
+/// Nothing is decoded until RecordDecoder_step() is called.
+///
+/// @param[in,out]  this  Pointer to RecordDecoder; may be stack-allocated
+/// @param[in]      schema  Describes the fields of each record. <em>Must
+///       outlive this decoder.</em>
+/// @param[in,out]  data  Writable, null-terminated buffer holding the
+///       delimited records. String fields are terminated in place, so
+///       emitted strings point into this buffer. <em>Ownership is not
+///       transferred to this function; the buffer must stay valid until
+///       decoding is finished.</em>
+/// @param[in]      len  Number of characters of data (excluding the null
+///       terminator)
+/// @param[in]      delim  Field delimiter
+/// @param[in]      context  Passed through to the emitter
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this, schema or data is NULL
+///          MPA_INVALID_INPUT_ERR if the schema is unusable
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RecordDecoder_init(RecordDecoder* this, const RecordSchema* schema, char* data, size_t len,
+                                     char delim, void* context) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(schema);
+  MPA_RETURN_IF_NULL(data);
+
+  if ( (schema->numFields == 0) || (schema->numFields > RECORD_SCHEMA_MAX_FIELDS) ) { return MPA_INVALID_INPUT_ERR; }
+
+  this->schema = schema;
+  this->binary = false;
+  this->context = context;
+  this->recordQty = 0;
+  return Tokenizer_init(&this->tok, data, len, delim);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Prepares to decode a set of binary records according to a schema.
+/// @see RecordSchema.h for the binary record layout.
+///
+/// @param[in,out]  this  Pointer to RecordDecoder; may be stack-allocated
+/// @param[in]      schema  Describes the fields of each record. <em>Must
+///       outlive this decoder.</em>
+/// @param[in,out]  data  Writable buffer holding the records. String
+///       fields are shifted and terminated in place, so emitted strings
+///       point into this buffer. <em>Ownership is not transferred to this
+///       function; the buffer must stay valid until decoding is
+///       finished.</em>
+/// @param[in]      len  Number of bytes of data
+/// @param[in]      context  Passed through to the emitter
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this, schema or data is NULL
+///          MPA_INVALID_INPUT_ERR if the schema is unusable
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RecordDecoder_initBinary(RecordDecoder* this, const RecordSchema* schema, uint8_t* data, size_t len,
+                                           void* context) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(schema);
+  MPA_RETURN_IF_NULL(data);
+
+  if ( (schema->numFields == 0) || (schema->numFields > RECORD_SCHEMA_MAX_FIELDS) ) { return MPA_INVALID_INPUT_ERR; }
+
+  this->schema = schema;
+  this->binary = true;
+  this->bin.pos = (len == 0) ? NULL : data;
+  this->bin.end = data + len;
+  this->context = context;
+  this->recordQty = 0;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Decodes up to maxRecords records, passing each one to the schema's
+/// emitter as soon as it is decoded, and then returns so that the caller
+/// can yield. Call again to resume where this call left off.
+///
+/// @param[in,out]  this  Pointer to an initialized RecordDecoder
+/// @param[in]      maxRecords  Upper bound on records decoded by this call
+/// @param[out]     done  Set to true once every record has been decoded
+///       or decoding has stopped on an error
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_INVALID_INPUT_ERR if a record is malformed; records before
+///            the malformed one were emitted
+///          MPA_OVERFLOW_ERR if a numeric field is out of range
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RecordDecoder_step(RecordDecoder* this, uint16_t maxRecords, bool* done) {
+  MPA_RETURN_IF_NULL(this);
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  const RecordSchema* schema = this->schema;
+  RecordValue values[RECORD_SCHEMA_MAX_FIELDS];
+  uint8_t fieldIdx = 0;
+
+  for (uint16_t stepQty = 0; (stepQty < maxRecords) && !RecordDecoder_done(this); stepQty++) {
+    mpaRet = this->binary ? RecordDecoder_decodeBinary(this, values, &fieldIdx)
+                          : RecordDecoder_decodeText(this, values, &fieldIdx);
+    if (mpaRet != MPA_SUCCESS) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Malformed %s record #%d, field %d: %s", schema->readable, this->recordQty, fieldIdx,
+              MagPebApp_getErrMsg(mpaRet));
+      *done = true;
+      return mpaRet;
+    }
+
+    if ( (schema->emit != NULL) && ((mpaRet = (*schema->emit)(this->context, values)) != MPA_SUCCESS) ) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Error storing %s record #%d: %s", schema->readable, this->recordQty,
+              MagPebApp_getErrMsg(mpaRet));
+    }
+    this->recordQty++;
+  }
+
+  *done = RecordDecoder_done(this);
+  return MPA_SUCCESS;
+}
+
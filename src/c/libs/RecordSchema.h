@@ -0,0 +1,88 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+#include "Tokenizer.h"
+
+
+#define RECORD_SCHEMA_MAX_FIELDS 8
+
+
+// Wire types of the fields that make up a record.
+//
+// Text records are delimited fields with integers in decimal. Binary
+// records are a little-endian uint16 byte count followed by the fields in
+// schema order: RF_U32 and RF_U16 as little-endian integers, RF_U8 and
+// RF_CC as one and two bytes, RF_STR as a uint8 byte count and the bytes themselves. Bytes
+// after the last known field of a binary record are skipped, so fields can
+// be appended to a binary schema without breaking older decoders.
+typedef enum RecordFieldType {
+  RF_U32 = 0,               ///< unsigned 32-bit integer
+  RF_U16,                   ///< unsigned 16-bit integer
+  RF_STR,                   ///< free text
+  RF_CC,                    ///< two-character ISO-3166 country code
+  RF_U8,                    ///< unsigned 8-bit integer, such as a session dictionary index
+} RecordFieldType;
+
+
+// A decoded field. Strings point into the buffer that was decoded; country
+// codes are held inline.
+typedef union RecordValue {
+  uint32_t u32;
+  uint16_t u16;
+  uint8_t  u8;
+  char*    str;
+  char     cc[3];
+} RecordValue;
+
+
+// RecordEmitter is a pointer to a function that receives one decoded
+// record; values are indexed in schema field order.
+typedef MagPebApp_ErrCode (*RecordEmitter)(void* context, const RecordValue* values);
+
+
+typedef struct RecordSchema {
+  const char*            readable;   ///< human-readable name of the record set, for logging
+  uint8_t                numFields;  ///< number of entries in fields
+  const RecordFieldType* fields;     ///< wire type of each field, in order
+  RecordEmitter          emit;       ///< called once per decoded record
+} RecordSchema;
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Declares a record schema from an X-macro field list of the form
+/// X(FIELD_NAME, RF_TYPE). This generates an enum of field indices
+/// (FIELD_NAME = 0, 1, ...), NAME_NUM_FIELDS, and NAME_fieldTypes[].
+///
+/// \code{.c}
+/// #define COUNTRY_FIELDS(X)  X(CNTRY_ID, RF_CC)  X(CNTRY_NAME, RF_STR)
+/// RECORD_SCHEMA_FIELDS(COUNTRY, COUNTRY_FIELDS)
+/// \endcode
+/////////////////////////////////////////////////////////////////////////////
+#define RECORD_SCHEMA_FIELD_IDX(name, type)   name,
+#define RECORD_SCHEMA_FIELD_TYPE(name, type)  type,
+#define RECORD_SCHEMA_FIELDS(NAME, FIELDS)                                     \
+    enum { FIELDS(RECORD_SCHEMA_FIELD_IDX) NAME##_NUM_FIELDS };               \
+    static const RecordFieldType NAME##_fieldTypes[] = { FIELDS(RECORD_SCHEMA_FIELD_TYPE) };
+
+
+// Resumable decoding state for one record set. A plain struct so that it
+// can be embedded in whatever owns the payload being decoded.
+typedef struct RecordDecoder {
+  const RecordSchema* schema;      ///< schema of the records being decoded
+  bool                binary;      ///< selects whether tok or bin tracks the position
+  Tokenizer           tok;         ///< position within a text payload
+  struct {
+    uint8_t*          pos;         ///< start of the next binary record, or NULL when all are consumed
+    const uint8_t*    end;         ///< one past the last byte of the binary payload
+  } bin;
+  void*               context;     ///< passed through to the emitter
+  uint16_t            recordQty;   ///< records decoded so far
+} RecordDecoder;
+
+
+MagPebApp_ErrCode RecordDecoder_init(RecordDecoder* this, const RecordSchema* schema, char* data, size_t len,
+                                     char delim, void* context);
+MagPebApp_ErrCode RecordDecoder_initBinary(RecordDecoder* this, const RecordSchema* schema, uint8_t* data, size_t len,
+                                           void* context);
+MagPebApp_ErrCode RecordDecoder_step(RecordDecoder* this, uint16_t maxRecords, bool* done);
@@ -0,0 +1,233 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "RetryPolicy.h"
+
+
+struct RetryPolicy {
+  RetryClassConfig* classes;
+  uint8_t           classQty;
+  RetryLimits       limits;
+  AppTimerCallback  retry;         ///< called once the next attempt may be made
+  void*             context;
+  AppTimer*         timer;         ///< the only timer; always set to the latest deadline
+  uint32_t          deadline;      ///< time (ms) at which timer fires
+  uint8_t           failures;      ///< consecutive failures since the last success
+  uint8_t           tokens;        ///< remaining retry budget
+  bool              starved;       ///< the timer waits for budget rather than a backoff
+  uint32_t          rngState;      ///< xorshift32 state for the jitter; never zero
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns a millisecond clock suitable for measuring short intervals.
+/////////////////////////////////////////////////////////////////////////////
+static uint32_t RetryPolicy_nowMs() {
+  time_t secs = 0;
+  uint16_t ms = 0;
+  time_ms(&secs, &ms);
+  return (uint32_t)secs * 1000 + ms;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the next number of the policy's own xorshift32 generator, so
+/// that drawing jitter leaves the global rand() sequence alone.
+/////////////////////////////////////////////////////////////////////////////
+static uint32_t RetryPolicy_random(RetryPolicy* this) {
+  uint32_t x = this->rngState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return (this->rngState = x);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Timer callback: the deadline has passed, so the owner may try again.
+/////////////////////////////////////////////////////////////////////////////
+static void RetryPolicy_fire(void* data) {
+  RetryPolicy* this = (RetryPolicy*) data;
+  this->timer = NULL;
+  if (this->starved) {
+    // Waiting out the cooldown earns back one retry.
+    this->starved = false;
+    if (this->tokens == 0) { this->tokens = 1; }
+  }
+  (*this->retry)(this->context);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Moves the timer to fire no sooner than delayMs from now. A deadline that
+/// is already later is kept.
+/////////////////////////////////////////////////////////////////////////////
+static void RetryPolicy_schedule(RetryPolicy* this, uint32_t delayMs) {
+  uint32_t deadline = RetryPolicy_nowMs() + delayMs;
+  if (this->timer != NULL) {
+    if ((int32_t)(deadline - this->deadline) <= 0) { return; }
+    if (app_timer_reschedule(this->timer, delayMs)) {
+      this->deadline = deadline;
+      return;
+    }
+  }
+  this->timer = app_timer_register(delayMs, RetryPolicy_fire, this);
+  this->deadline = deadline;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Constructor
+/// @param[in]      classes  Backoff settings of each class
+/// @param[in]      classQty  Number of classes
+/// @param[in]      limits  Circuit breaker and retry budget settings
+/// @param[in]      retry  Called when a scheduled retry is due
+/// @param[in]      context  Passed to retry
+/////////////////////////////////////////////////////////////////////////////
+RetryPolicy* RetryPolicy_create(const RetryClassConfig* classes, uint8_t classQty, const RetryLimits limits,
+                                AppTimerCallback retry, void* context) {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Creating RetryPolicy [%d classes]", classQty);
+  if ( (classes == NULL) || (classQty == 0) || (retry == NULL) ) { return NULL; }
+
+  RetryPolicy* newRetryPolicy = malloc(sizeof(*newRetryPolicy));
+  if (newRetryPolicy == NULL) { return NULL; }
+
+  if ( (newRetryPolicy->classes = malloc(classQty * sizeof(*classes))) == NULL) {
+    free(newRetryPolicy);
+    return NULL;
+  }
+  memcpy(newRetryPolicy->classes, classes, classQty * sizeof(*classes));
+  newRetryPolicy->classQty = classQty;
+  newRetryPolicy->limits = limits;
+  newRetryPolicy->retry = retry;
+  newRetryPolicy->context = context;
+  newRetryPolicy->timer = NULL;
+  newRetryPolicy->deadline = 0;
+  newRetryPolicy->failures = 0;
+  newRetryPolicy->tokens = limits.budget;
+  newRetryPolicy->starved = false;
+  newRetryPolicy->rngState = RetryPolicy_nowMs() | 1;
+  return newRetryPolicy;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Destroys RetryPolicy, cancelling a pending retry.
+/// @param[in,out]  this  Pointer to RetryPolicy; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RetryPolicy_destroy(RetryPolicy* this) {
+  MPA_RETURN_IF_NULL(this);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Destroying RetryPolicy");
+
+  if (this->timer != NULL) { app_timer_cancel(this->timer);  this->timer = NULL; }
+  if (this->classes != NULL) { free(this->classes);  this->classes = NULL; }
+
+  free(this); this = NULL;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Records a failed attempt and decides whether the item is retried.
+/// A retry is scheduled after an exponential backoff with jitter, drawn
+/// from [bound/2, bound] where the bound doubles with each attempt up to
+/// the class maximum. Once the failures in a row reach the breaker
+/// threshold, nothing is retried until the cooldown has passed. While the
+/// retry budget is spent, the retry waits, without counting as an attempt,
+/// until a success earns a retry back or the breaker cooldown has passed.
+/// @param[in,out]  this  Pointer to RetryPolicy; must be already allocated
+/// @param[in]      cls  Class of the item that failed
+/// @param[in,out]  attempts  Retries already made for the item; incremented
+///       when another is scheduled
+/// @param[out]     retry  Set to false when the item has used up its
+///       attempts, and should be abandoned
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if a pointer argument is NULL
+///          MPA_INVALID_INPUT_ERR if cls is out of range
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RetryPolicy_failed(RetryPolicy* this, uint8_t cls, uint8_t* attempts, bool* retry) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(attempts);
+  MPA_RETURN_IF_NULL(retry);
+  if (cls >= this->classQty) { return MPA_INVALID_INPUT_ERR; }
+  const RetryClassConfig* config = &this->classes[cls];
+
+  if (this->failures < UINT8_MAX) { this->failures++; }
+  if ( (this->limits.breakerThreshold > 0) && (this->failures >= this->limits.breakerThreshold) ) {
+    // Opens the breaker, or keeps it open after a failed trial attempt.
+    APP_LOG(APP_LOG_LEVEL_WARNING, "RetryPolicy breaker open after %d failures", this->failures);
+    RetryPolicy_schedule(this, this->limits.breakerCooldownMs);
+  }
+
+  *retry = (*attempts < config->maxAttempts);
+  if (!*retry) { return MPA_SUCCESS; }
+
+  if (this->tokens == 0) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "RetryPolicy budget spent; class %d waits", cls);
+    this->starved = true;
+    RetryPolicy_schedule(this, this->limits.breakerCooldownMs);
+    return MPA_SUCCESS;
+  }
+
+  this->tokens--;
+  uint32_t bound = config->baseMs;
+  for (uint8_t idx=0; (idx < *attempts) && (bound < config->maxMs); idx++) { bound *= 2; }
+  if (bound > config->maxMs) { bound = config->maxMs; }
+  uint32_t delayMs = bound / 2 + RetryPolicy_random(this) % (bound / 2 + 1);
+  (*attempts)++;
+
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "RetryPolicy attempt %d of class %d in %ld ms", *attempts, cls, delayMs);
+  RetryPolicy_schedule(this, delayMs);
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Records a successful attempt: closes the breaker and earns back one
+/// retry of the budget. A retry that waits for budget is called back now.
+/// @param[in,out]  this  Pointer to RetryPolicy; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RetryPolicy_succeeded(RetryPolicy* this) {
+  MPA_RETURN_IF_NULL(this);
+
+  this->failures = 0;
+  if (this->tokens < this->limits.budget) { this->tokens++; }
+  if (this->starved) {
+    this->starved = false;
+    if (this->timer != NULL) { app_timer_cancel(this->timer); }
+    this->timer = app_timer_register(0, RetryPolicy_fire, this);
+    this->deadline = RetryPolicy_nowMs();
+  }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Forgets past failures: cancels any backoff without calling back, closes
+/// the breaker and restores the full retry budget. For when the failures
+/// had a known cause that has gone away.
+/// @param[in,out]  this  Pointer to RetryPolicy; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RetryPolicy_reset(RetryPolicy* this) {
+  MPA_RETURN_IF_NULL(this);
+
+  if (this->timer != NULL) { app_timer_cancel(this->timer);  this->timer = NULL; }
+  this->failures = 0;
+  this->tokens = this->limits.budget;
+  this->starved = false;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether attempts should wait, because a backoff is running or
+/// the breaker is open. The retry callback runs when the wait is over.
+/// @param[in]      this  Pointer to RetryPolicy; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+bool RetryPolicy_waiting(const RetryPolicy* this) {
+  return (this != NULL) && (this->timer != NULL);
+}
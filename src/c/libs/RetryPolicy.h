@@ -0,0 +1,34 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+typedef struct RetryPolicy RetryPolicy;
+
+
+// Backoff settings for one class of work. Classes are indexed like the
+// caller's priority classes.
+typedef struct RetryClassConfig {
+  uint16_t baseMs;              ///< upper bound of the first backoff
+  uint16_t maxMs;               ///< cap on the exponential backoff
+  uint8_t  maxAttempts;         ///< retries allowed per item before it is abandoned
+} RetryClassConfig;
+
+
+// Circuit breaker and retry budget settings, shared by every class.
+typedef struct RetryLimits {
+  uint8_t  breakerThreshold;    ///< consecutive failures that open the breaker
+  uint16_t breakerCooldownMs;   ///< time the breaker stays open before a trial attempt
+  uint8_t  budget;              ///< retries available at once; a success earns one back, as does a cooldown spent at zero
+} RetryLimits;
+
+
+RetryPolicy* RetryPolicy_create(const RetryClassConfig* classes, uint8_t classQty, const RetryLimits limits,
+                                AppTimerCallback retry, void* context);
+MagPebApp_ErrCode RetryPolicy_destroy(RetryPolicy* this);
+
+MagPebApp_ErrCode RetryPolicy_failed(RetryPolicy* this, uint8_t cls, uint8_t* attempts, bool* retry);
+MagPebApp_ErrCode RetryPolicy_succeeded(RetryPolicy* this);
+MagPebApp_ErrCode RetryPolicy_reset(RetryPolicy* this);
+bool RetryPolicy_waiting(const RetryPolicy* this);
@@ -2,16 +2,8 @@
 #include "RingBuffer_Internal.h"
 
 
-#define RING_BUFFER_EMPTY(RB) ((RB)->read == (RB)->write)
-
-#define RING_BUFFER_FULL(RB) ((RB)->read == ( (RB)->write + 1 ) % ((RB)->length))
-
-#define RING_BUFFER_ADVANCE_READ(RB, N) ((RB)->read = ((RB)->read + N) % ((RB)->length) )
-
-#define RING_BUFFER_ADVANCE_WRITE(RB, N) ((RB)->write = ((RB)->write + N) % ((RB)->length) )
-
 /////////////////////////////////////////////////////////////////////////////
-/// Constructor
+/// Constructor. The RingBuffer and its slots are a single allocation.
 /// @param[in]      capacity   Defines the number of slots available in this
 ///       RingBuffer data structure.
 /////////////////////////////////////////////////////////////////////////////
@@ -19,10 +11,16 @@ RingBuffer* RingBuffer_create(size_t capacity) {
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Creating RingBuffer [%zd]", capacity);
   int mpaRet;
 
-  RingBuffer* newRingBuffer = malloc(sizeof(*newRingBuffer));
+  size_t slotQty = PtrRing_slotQty(capacity);
+  if (slotQty == 0) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Invalid RingBuffer capacity: %zd", capacity);
+    return NULL;
+  }
+
+  RingBuffer* newRingBuffer = malloc(sizeof(*newRingBuffer) + slotQty * sizeof(newRingBuffer->slots[0]));
   if ( (mpaRet = RingBuffer_init(newRingBuffer, capacity)) != MPA_SUCCESS) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Could not initialize: %s", MagPebApp_getErrMsg(mpaRet));
-    RingBuffer_destroy(newRingBuffer);  newRingBuffer = NULL;
+    if (newRingBuffer != NULL) { free(newRingBuffer);  newRingBuffer = NULL; }
   }
 
   return newRingBuffer;
@@ -31,53 +29,29 @@ RingBuffer* RingBuffer_create(size_t capacity) {
 
 /////////////////////////////////////////////////////////////////////////////
 /// Internal initialization
-/// @param[in,out]  this  Pointer to RingBuffer; must be already allocated
+/// @param[in,out]  this  Pointer to RingBuffer; must be already allocated,
+///       with room for PtrRing_slotQty(capacity) slots
 /// @param[in]      capacity   Defines the number of slots in the RingBuffer
 ///       data structure.
+/// @return  MPA_SUCCESS on success
+///          MPA_INVALID_INPUT_ERR if capacity is zero or too large
 /////////////////////////////////////////////////////////////////////////////
 MagPebApp_ErrCode RingBuffer_init(RingBuffer* this, size_t capacity) {
   MPA_RETURN_IF_NULL(this);
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Initializing RingBuffer [%zd]", capacity);
-  MagPebApp_ErrCode mpaRet = MPA_SUCCESS, myRet = MPA_OUT_OF_MEMORY_ERR;
 
-  this->buf = NULL;
-  this->read = 0;
-  this->write = 0;
-
-  if ( (capacity == 0) || ((capacity + 1) == 0) ) { myRet = MPA_INVALID_INPUT_ERR; goto freemem; }
-  this->length = capacity + 1;
-  
-  // Allocate slots
-  this->buf = calloc(this->length, sizeof(*this->buf));
-  if (this->buf == NULL) { goto freemem; }
-
-  return MPA_SUCCESS;
-
-freemem:
-  APP_LOG(APP_LOG_LEVEL_ERROR, "Error... freeing memory");
-  if (this != NULL) {
-    RingBuffer_destroy(this);  this = NULL;
-  }
-  return myRet;
+  return PtrRing_init(&this->ring, this->slots, capacity);
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Destroys RingBuffer and frees allocated memory for slots. If the slots
-/// are pointers to heap-allocated memory, that heap-allocated memory is
-/// not freed (by default).
+/// Destroys RingBuffer. If the slots are pointers to heap-allocated memory,
+/// that heap-allocated memory is not freed (by default).
 /// @param[in,out]  this  Pointer to RingBuffer; must be already allocated
 /////////////////////////////////////////////////////////////////////////////
 MagPebApp_ErrCode RingBuffer_destroy(RingBuffer* this) {
   MPA_RETURN_IF_NULL(this);
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Destroying RingBuffer");
-  MagPebApp_ErrCode mpaRet;
-
-  // Free memory for slots
-  if (this->buf != NULL) {
-    free(this->buf);
-    this->buf = NULL;
-  }
 
   free(this); this = NULL;
   return MPA_SUCCESS;
@@ -94,7 +68,7 @@ MagPebApp_ErrCode RingBuffer_destroy(RingBuffer* this) {
 /////////////////////////////////////////////////////////////////////////////
 MagPebApp_ErrCode RingBuffer_empty(RingBuffer* this, bool* out) {
   MPA_RETURN_IF_NULL(this);
-  *out = RING_BUFFER_EMPTY(this);
+  *out = PtrRing_empty(&this->ring);
   return MPA_SUCCESS;
 }
 
@@ -109,7 +83,22 @@ MagPebApp_ErrCode RingBuffer_empty(RingBuffer* this, bool* out) {
 /////////////////////////////////////////////////////////////////////////////
 MagPebApp_ErrCode RingBuffer_full(RingBuffer* this, bool* out) {
   MPA_RETURN_IF_NULL(this);
-  *out = RING_BUFFER_FULL(this);
+  *out = PtrRing_full(&this->ring);
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the number of data elements stored in the RingBuffer.
+/// @param[in,out]  this  Pointer to RingBuffer; must be already allocated
+/// @param[out]     out  Pointer to the element count
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if the RingBuffer pointer is null
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RingBuffer_count(RingBuffer* this, size_t* out) {
+  MPA_RETURN_IF_NULL(this);
+  *out = PtrRing_count(&this->ring);
   return MPA_SUCCESS;
 }
 
@@ -124,15 +113,28 @@ MagPebApp_ErrCode RingBuffer_full(RingBuffer* this, bool* out) {
 ///          MPA_EMPTY_ERR if the RingBuffer is empty (data will be NULL)
 /////////////////////////////////////////////////////////////////////////////
 MagPebApp_ErrCode RingBuffer_peek(RingBuffer* this, void** data) {
+  return RingBuffer_peekAt(this, 0, data);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Provides the data element at the specified position, counting from the
+/// first, without removing any buffer slots.
+/// @param[in,out]  this  Pointer to RingBuffer; must be already allocated
+/// @param[in]      idx  Zero-based position of the element
+/// @param[out]     data  Void double-pointer to data at that slot.
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if the RingBuffer pointer is null
+///          MPA_EMPTY_ERR if the RingBuffer holds no more than idx elements
+///            (data will be NULL)
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RingBuffer_peekAt(RingBuffer* this, size_t idx, void** data) {
   MPA_RETURN_IF_NULL(this);
-  
-  if (RING_BUFFER_EMPTY(this)) {
-    *data = NULL;
-    return MPA_EMPTY_ERR;
-  }
-  
-  *data = this->buf[this->read];
-  return MPA_SUCCESS;
+
+  void** slot = PtrRing_at(&this->ring, idx);
+  *data = (slot != NULL) ? *slot : NULL;
+  return (slot != NULL) ? MPA_SUCCESS : MPA_EMPTY_ERR;
 }
 
 
@@ -148,13 +150,8 @@ MagPebApp_ErrCode RingBuffer_peek(RingBuffer* this, void** data) {
 MagPebApp_ErrCode RingBuffer_drop(RingBuffer* this) {
   MPA_RETURN_IF_NULL(this);
   APP_LOG(APP_LOG_LEVEL_DEBUG, "RingBuffer DROP");
-  
-  if (RING_BUFFER_EMPTY(this)) {
-    return MPA_EMPTY_ERR;
-  }
-  
-  RING_BUFFER_ADVANCE_READ(this, 1);
-  return MPA_SUCCESS;
+
+  return PtrRing_pop(&this->ring, NULL);
 }
 
 
@@ -170,16 +167,30 @@ MagPebApp_ErrCode RingBuffer_drop(RingBuffer* this) {
 MagPebApp_ErrCode RingBuffer_read(RingBuffer* this, void** data) {
   MPA_RETURN_IF_NULL(this);
   APP_LOG(APP_LOG_LEVEL_DEBUG, "RingBuffer READ");
-  
-  if (RING_BUFFER_EMPTY(this)) {
-    *data = NULL;
-    return MPA_EMPTY_ERR;
-  }
-  
-  *data = this->buf[this->read];
-  RING_BUFFER_ADVANCE_READ(this, 1);
-  
-  return MPA_SUCCESS;
+
+  *data = NULL;
+  return PtrRing_pop(&this->ring, data);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Provides the data element at the specified position and removes it,
+/// moving the elements behind it forward by one slot.
+/// @param[in,out]  this  Pointer to RingBuffer; must be already allocated
+/// @param[in]      idx  Zero-based position of the element
+/// @param[out]     data  Void double-pointer to data at that slot.
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if the RingBuffer pointer is null
+///          MPA_EMPTY_ERR if the RingBuffer holds no more than idx elements
+///            (data will be NULL)
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode RingBuffer_removeAt(RingBuffer* this, size_t idx, void** data) {
+  MPA_RETURN_IF_NULL(this);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "RingBuffer REMOVE %zd", idx);
+
+  *data = NULL;
+  return PtrRing_removeAt(&this->ring, idx, data);
 }
 
 
@@ -196,13 +207,7 @@ MagPebApp_ErrCode RingBuffer_read(RingBuffer* this, void** data) {
 MagPebApp_ErrCode RingBuffer_write(RingBuffer* this, void* data) {
   MPA_RETURN_IF_NULL(this);
   APP_LOG(APP_LOG_LEVEL_DEBUG, "RingBuffer WRITE");
-  
-  if (RING_BUFFER_FULL(this)) {
-    return MPA_FULL_ERR;
-  }
-  
-  this->buf[this->write] = data;
-  RING_BUFFER_ADVANCE_WRITE(this, 1);
-  return MPA_SUCCESS;
+
+  return PtrRing_push(&this->ring, data);
 }
 
@@ -12,9 +12,12 @@ MagPebApp_ErrCode RingBuffer_destroy(RingBuffer* this);
 
 MagPebApp_ErrCode RingBuffer_empty(RingBuffer* this, bool*);
 MagPebApp_ErrCode RingBuffer_full(RingBuffer* this, bool*);
+MagPebApp_ErrCode RingBuffer_count(RingBuffer* this, size_t*);
 
 MagPebApp_ErrCode RingBuffer_peek(RingBuffer* this, void**);
+MagPebApp_ErrCode RingBuffer_peekAt(RingBuffer* this, size_t, void**);
 MagPebApp_ErrCode RingBuffer_drop(RingBuffer* this);
 MagPebApp_ErrCode RingBuffer_read(RingBuffer* this, void**);
+MagPebApp_ErrCode RingBuffer_removeAt(RingBuffer* this, size_t, void**);
 
 MagPebApp_ErrCode RingBuffer_write(RingBuffer* this, void*);
\ No newline at end of file
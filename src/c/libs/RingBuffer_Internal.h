@@ -1,13 +1,14 @@
 #include <pebble.h>
 #include "magpebapp.h"
 #include "RingBuffer.h"
+#include "TypedRing.h"
 
 
+TYPED_RING_DEFINE_SIZED(PtrRing, void*)
+
 struct RingBuffer {
-  size_t    length;
-  size_t    read;
-  size_t    write;
-  void**    buf;
+  PtrRing   ring;
+  void*     slots[];        ///< the ring's slots, allocated together with the RingBuffer
 };
 
 
@@ -0,0 +1,229 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "SendScheduler.h"
+
+
+typedef struct SendClass {
+  RingBuffer*  queue;
+  SendOverflow overflow;
+  uint8_t      skips;           ///< pops that passed over this class while it had items waiting
+} SendClass;
+
+
+struct SendScheduler {
+  SendClass* classes;           ///< in priority order, highest first
+  uint8_t    classQty;
+  uint8_t    agingLimit;        ///< skips after which a waiting class is served next
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Constructor
+/// @param[in]      classes  Configuration of each priority class, highest
+///       priority first
+/// @param[in]      classQty  Number of priority classes
+/// @param[in]      agingLimit  Number of times a class with waiting items
+///       may be passed over for higher classes before it is served anyway.
+///       Zero disables aging.
+/////////////////////////////////////////////////////////////////////////////
+SendScheduler* SendScheduler_create(const SendClassConfig* classes, uint8_t classQty, uint8_t agingLimit) {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Creating SendScheduler [%d classes]", classQty);
+  if ( (classes == NULL) || (classQty == 0) ) { return NULL; }
+
+  SendScheduler* newSendScheduler = malloc(sizeof(*newSendScheduler));
+  if (newSendScheduler == NULL) { return NULL; }
+
+  newSendScheduler->classQty = classQty;
+  newSendScheduler->agingLimit = agingLimit;
+  if ( (newSendScheduler->classes = calloc(classQty, sizeof(*newSendScheduler->classes))) == NULL) { goto freemem; }
+
+  for (uint8_t cls=0; cls<classQty; cls++) {
+    SendClass* sc = &newSendScheduler->classes[cls];
+    sc->overflow = classes[cls].overflow;
+    sc->skips = 0;
+    if ( (sc->queue = RingBuffer_create(classes[cls].capacity)) == NULL) { goto freemem; }
+  }
+  return newSendScheduler;
+
+freemem:
+  APP_LOG(APP_LOG_LEVEL_ERROR, "Error... freeing memory");
+  SendScheduler_destroy(newSendScheduler);
+  return NULL;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Destroys SendScheduler. Like RingBuffer, it does not free the items that
+/// are still queued.
+/// @param[in,out]  this  Pointer to SendScheduler; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SendScheduler_destroy(SendScheduler* this) {
+  MPA_RETURN_IF_NULL(this);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Destroying SendScheduler");
+
+  if (this->classes != NULL) {
+    for (uint8_t cls=0; cls<this->classQty; cls++) {
+      if (this->classes[cls].queue != NULL) { RingBuffer_destroy(this->classes[cls].queue);  this->classes[cls].queue = NULL; }
+    }
+    free(this->classes);  this->classes = NULL;
+  }
+
+  free(this); this = NULL;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Queues an item at the end of its priority class.
+/// @param[in,out]  this  Pointer to SendScheduler; must be already allocated
+/// @param[in]      cls  Priority class (index into the configured classes)
+/// @param[in]      item  Item to queue. <em>Ownership stays with the
+///       caller.</em>
+/// @param[out]     evicted  Set to the item that was evicted to make room,
+///       which the caller must release; otherwise NULL
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this or evicted is NULL
+///          MPA_INVALID_INPUT_ERR if cls is out of range
+///          MPA_FULL_ERR if the class is full and rejects new items
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SendScheduler_push(SendScheduler* this, uint8_t cls, void* item, void** evicted) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(evicted);
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+
+  *evicted = NULL;
+  if (cls >= this->classQty) { return MPA_INVALID_INPUT_ERR; }
+  SendClass* sc = &this->classes[cls];
+
+  bool full = false;
+  if ( (mpaRet = RingBuffer_full(sc->queue, &full)) != MPA_SUCCESS) { return mpaRet; }
+  if (full) {
+    if (sc->overflow == SEND_OVERFLOW_REJECT) { return MPA_FULL_ERR; }
+    if ( (mpaRet = RingBuffer_read(sc->queue, evicted)) != MPA_SUCCESS) { return mpaRet; }
+  }
+
+  return RingBuffer_write(sc->queue, item);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Removes the next item to send: the oldest item of the highest priority
+/// class that has any, unless a lower class has reached the aging limit,
+/// in which case the most-skipped such class is served first.
+/// @param[in,out]  this  Pointer to SendScheduler; must be already allocated
+/// @param[out]     item  The next item; NULL if nothing is queued
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_EMPTY_ERR if no class has items queued
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SendScheduler_pop(SendScheduler* this, void** item) {
+  MPA_RETURN_IF_NULL(this);
+  *item = NULL;
+
+  int chosen = -1, starved = -1;
+  for (uint8_t cls=0; cls<this->classQty; cls++) {
+    SendClass* sc = &this->classes[cls];
+    bool empty = true;
+    RingBuffer_empty(sc->queue, &empty);
+    if (empty) { sc->skips = 0;  continue; }
+
+    if (chosen < 0) {
+      chosen = cls;
+    } else if ( (this->agingLimit > 0) && (sc->skips >= this->agingLimit) ) {
+      if ( (starved < 0) || (sc->skips > this->classes[starved].skips) ) { starved = cls; }
+    }
+  }
+  if (chosen < 0) { return MPA_EMPTY_ERR; }
+  if (starved >= 0) { chosen = starved; }
+
+  // Every other class with waiting items was passed over once more.
+  for (uint8_t cls=0; cls<this->classQty; cls++) {
+    SendClass* sc = &this->classes[cls];
+    bool empty = true;
+    RingBuffer_empty(sc->queue, &empty);
+    if ( (cls != chosen) && !empty && (sc->skips < UINT8_MAX) ) { sc->skips++; }
+  }
+  this->classes[chosen].skips = 0;
+
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "SendScheduler serving class %d", chosen);
+  return RingBuffer_read(this->classes[chosen].queue, item);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Finds the first queued item that matches, searching from the highest
+/// priority class down and from the oldest item in each class.
+/// @param[in,out]  this  Pointer to SendScheduler; must be already allocated
+/// @param[in]      match  Returns true for the item being looked for
+/// @param[in]      context  Passed to match
+/// @param[out]     item  The matching item; NULL if there is none
+/// @param[out]     cls  Priority class holding the item; may be NULL
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this or match is NULL
+///          MPA_EMPTY_ERR if no queued item matches
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SendScheduler_find(SendScheduler* this, SendMatch match, const void* context, void** item, uint8_t* cls) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(match);
+  *item = NULL;
+
+  for (uint8_t clsIdx=0; clsIdx<this->classQty; clsIdx++) {
+    void* data = NULL;
+    for (size_t idx=0; RingBuffer_peekAt(this->classes[clsIdx].queue, idx, &data) == MPA_SUCCESS; idx++) {
+      if ((*match)(data, context)) {
+        *item = data;
+        if (cls != NULL) { *cls = clsIdx; }
+        return MPA_SUCCESS;
+      }
+    }
+  }
+  return MPA_EMPTY_ERR;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Removes a queued item, wherever it is. The item itself is not freed.
+/// @param[in,out]  this  Pointer to SendScheduler; must be already allocated
+/// @param[in]      item  Item to remove
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_EMPTY_ERR if the item is not queued
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SendScheduler_remove(SendScheduler* this, const void* item) {
+  MPA_RETURN_IF_NULL(this);
+
+  for (uint8_t cls=0; cls<this->classQty; cls++) {
+    RingBuffer* queue = this->classes[cls].queue;
+    void* data = NULL;
+    for (size_t idx=0; RingBuffer_peekAt(queue, idx, &data) == MPA_SUCCESS; idx++) {
+      if (data == item) { return RingBuffer_removeAt(queue, idx, &data); }
+    }
+  }
+  return MPA_EMPTY_ERR;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether no class has items queued.
+/// @param[in,out]  this  Pointer to SendScheduler; must be already allocated
+/// @param[out]     out  Pointer to boolean (true if empty)
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SendScheduler_empty(SendScheduler* this, bool* out) {
+  MPA_RETURN_IF_NULL(this);
+
+  *out = true;
+  for (uint8_t cls=0; cls<this->classQty; cls++) {
+    bool empty = true;
+    RingBuffer_empty(this->classes[cls].queue, &empty);
+    if (!empty) { *out = false;  break; }
+  }
+  return MPA_SUCCESS;
+}
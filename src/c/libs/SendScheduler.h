@@ -0,0 +1,38 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+#include "RingBuffer.h"
+
+
+typedef struct SendScheduler SendScheduler;
+
+
+// What happens to a push into a priority class whose queue is full.
+typedef enum SendOverflow {
+  SEND_OVERFLOW_REJECT,         ///< the new item is refused
+  SEND_OVERFLOW_EVICT_OLDEST    ///< the oldest item in the class makes room for the new one
+} SendOverflow;
+
+
+// SendMatch is a pointer to a function that returns whether a queued item
+// matches the context passed to SendScheduler_find().
+typedef bool (*SendMatch)(const void* item, const void* context);
+
+
+// Describes one priority class. Classes are passed in priority order,
+// highest first.
+typedef struct SendClassConfig {
+  uint8_t      capacity;        ///< maximum number of items queued in the class
+  SendOverflow overflow;        ///< policy for pushes into a full queue
+} SendClassConfig;
+
+
+SendScheduler* SendScheduler_create(const SendClassConfig* classes, uint8_t classQty, uint8_t agingLimit);
+MagPebApp_ErrCode SendScheduler_destroy(SendScheduler* this);
+
+MagPebApp_ErrCode SendScheduler_push(SendScheduler* this, uint8_t cls, void* item, void** evicted);
+MagPebApp_ErrCode SendScheduler_pop(SendScheduler* this, void** item);
+MagPebApp_ErrCode SendScheduler_find(SendScheduler* this, SendMatch, const void* context, void** item, uint8_t* cls);
+MagPebApp_ErrCode SendScheduler_remove(SendScheduler* this, const void* item);
+MagPebApp_ErrCode SendScheduler_empty(SendScheduler* this, bool*);
@@ -0,0 +1,225 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "SessionDict.h"
+
+
+// Entries are allocated in steps of this many.
+#define SESSION_DICT_GROW_QTY 32
+
+
+// Short keys (such as country codes) that the phone numbered for the
+// current session. Keys are stored back to back, each null-terminated in
+// keyLen+1 bytes; an entry whose first byte is zero is undefined.
+struct SessionDict {
+  uint16_t id;              ///< session the indices belong to; 0 if none
+  uint8_t  keyLen;          ///< length of every key
+  uint16_t capacity;        ///< entries allocated
+  uint16_t size;            ///< one past the highest defined index
+  char*    keys;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the storage of one entry.
+/////////////////////////////////////////////////////////////////////////////
+static char* SessionDict_entry(const SessionDict* this, uint16_t idx) {
+  return this->keys + (size_t)idx * (this->keyLen + 1);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Constructor
+/// @param[in]      keyLen  Length of every key, in characters
+/////////////////////////////////////////////////////////////////////////////
+SessionDict* SessionDict_create(uint8_t keyLen) {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Creating SessionDict [%d]", keyLen);
+  if (keyLen == 0) { return NULL; }
+
+  SessionDict* newSessionDict = malloc(sizeof(*newSessionDict));
+  if (newSessionDict == NULL) { return NULL; }
+
+  newSessionDict->id = 0;
+  newSessionDict->keyLen = keyLen;
+  newSessionDict->capacity = 0;
+  newSessionDict->size = 0;
+  newSessionDict->keys = NULL;
+  return newSessionDict;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Destroys SessionDict.
+/// @param[in,out]  this  Pointer to SessionDict; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SessionDict_destroy(SessionDict* this) {
+  MPA_RETURN_IF_NULL(this);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Destroying SessionDict");
+
+  if (this->keys != NULL) { free(this->keys);  this->keys = NULL; }
+  free(this); this = NULL;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Forgets every entry and starts the dictionary of another session.
+/// @param[in,out]  this  Pointer to SessionDict; must be already allocated
+/// @param[in]      id  Session the following definitions belong to; 0 if
+///       there is none, which leaves the dictionary unusable until the
+///       next reset
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SessionDict_reset(SessionDict* this, uint16_t id) {
+  MPA_RETURN_IF_NULL(this);
+
+  this->id = id;
+  this->size = 0;
+  if (this->keys != NULL) { memset(this->keys, 0, (size_t)this->capacity * (this->keyLen + 1)); }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the session the entries belong to; 0 if there is none.
+/////////////////////////////////////////////////////////////////////////////
+uint16_t SessionDict_id(const SessionDict* this) {
+  return (this == NULL) ? 0 : this->id;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Defines (or redefines) the key at an index.
+/// @param[in,out]  this  Pointer to SessionDict; must be already allocated
+/// @param[in]      idx  Index the phone assigned to the key
+/// @param[in]      key  Key of exactly keyLen characters. <em>Ownership is
+///       not transferred; the key is copied.</em>
+/// @return  MPA_SUCCESS on success
+///          MPA_INVALID_INPUT_ERR if the key has the wrong length
+///          MPA_OUT_OF_MEMORY_ERR if the entries could not be grown
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SessionDict_define(SessionDict* this, uint8_t idx, const char* key) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(key);
+
+  if (strlen(key) != this->keyLen) { return MPA_INVALID_INPUT_ERR; }
+
+  if (idx >= this->capacity) {
+    uint16_t capacity = ((idx / SESSION_DICT_GROW_QTY) + 1) * SESSION_DICT_GROW_QTY;
+    if (capacity > SESSION_DICT_MAX_ENTRIES) { capacity = SESSION_DICT_MAX_ENTRIES; }
+    char* tmp = realloc(this->keys, (size_t)capacity * (this->keyLen + 1));
+    if (tmp == NULL) { return MPA_OUT_OF_MEMORY_ERR; }
+    this->keys = tmp;
+    memset(SessionDict_entry(this, this->capacity), 0, (size_t)(capacity - this->capacity) * (this->keyLen + 1));
+    this->capacity = capacity;
+  }
+
+  memcpy(SessionDict_entry(this, idx), key, this->keyLen + 1);
+  if (idx >= this->size) { this->size = idx + 1; }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Looks up the key at an index.
+/// @param[in]      this  Pointer to SessionDict; must be already allocated
+/// @param[in]      idx  Index to look up
+/// @param[out]     key  Receives the key, owned by the dictionary and
+///       valid until it is redefined or reset
+/// @return  MPA_SUCCESS on success
+///          MPA_INVALID_INPUT_ERR if nothing is defined at idx
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SessionDict_lookup(const SessionDict* this, uint8_t idx, const char** key) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(key);
+
+  if ( (idx >= this->size) || (*SessionDict_entry(this, idx) == '\0') ) { return MPA_INVALID_INPUT_ERR; }
+  *key = SessionDict_entry(this, idx);
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Finds the index of a key.
+/// @param[in]      this  Pointer to SessionDict; must be already allocated
+/// @param[in]      key  Key to find; only its first keyLen characters are
+///       compared
+/// @param[out]     idx  Receives the index
+/// @return  MPA_SUCCESS on success
+///          MPA_INVALID_INPUT_ERR if the key is not defined
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SessionDict_find(const SessionDict* this, const char* key, uint8_t* idx) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(key);
+  MPA_RETURN_IF_NULL(idx);
+
+  for (uint16_t entry=0; entry<this->size; entry++) {
+    if (strncmp(SessionDict_entry(this, entry), key, this->keyLen) == 0) {
+      *idx = (uint8_t) entry;
+      return MPA_SUCCESS;
+    }
+  }
+  return MPA_INVALID_INPUT_ERR;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Encodes a list of keys as a coverage bitmap: bit (idx % 8) of byte
+/// (idx / 8) is set for every key in the list. The bitmap is written as
+/// lowercase hex, two characters per byte, so that it can travel as a
+/// string.
+/// @param[in]      this  Pointer to SessionDict; must be already allocated
+/// @param[in]      keys  Keys separated by sep; may be empty
+/// @param[in]      sep  Key separator
+/// @param[out]     hex  Pointer to the hex C-string; must be NULL upon
+///       entry to this function. <em>Ownership of this string is
+///       transferred to the caller, who must free it.</em>
+/// @return  MPA_SUCCESS on success
+///          MPA_INVALID_INPUT_ERR if hex is not NULL on entry, or a key
+///            is not defined (the list cannot be coded)
+///          MPA_OUT_OF_MEMORY_ERR if a memory allocation fails
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode SessionDict_coverage(const SessionDict* this, const char* keys, char sep, char** hex) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(keys);
+  MPA_RETURN_IF_NULL(hex);
+  if (*hex != NULL) { return MPA_INVALID_INPUT_ERR; }
+
+  MagPebApp_ErrCode mpaRet = MPA_OUT_OF_MEMORY_ERR;
+  static const char digits[] = "0123456789abcdef";
+  size_t byteQty = (this->size + 7) / 8;
+  uint8_t* bitmap = NULL;
+  char* str = NULL;
+
+  if ( (bitmap = calloc(byteQty + 1, sizeof(*bitmap))) == NULL) { goto freemem; }
+  for (const char* key = keys; *key != '\0'; ) {
+    uint8_t idx = 0;
+    const char* next = strchr(key, sep);
+    size_t len = (next == NULL) ? strlen(key) : (size_t)(next - key);
+    if ( (len != this->keyLen) || (SessionDict_find(this, key, &idx) != MPA_SUCCESS) ) {
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "SessionDict has no index for %.*s", (int)len, key);
+      mpaRet = MPA_INVALID_INPUT_ERR;
+      goto freemem;
+    }
+    bitmap[idx / 8] |= (uint8_t)(1 << (idx % 8));
+    key = (next == NULL) ? key + len : next + 1;
+  }
+
+  if ( (str = malloc(byteQty * 2 + 1)) == NULL) { goto freemem; }
+  for (size_t byte=0; byte<byteQty; byte++) {
+    str[byte * 2] = digits[bitmap[byte] >> 4];
+    str[byte * 2 + 1] = digits[bitmap[byte] & 0x0F];
+  }
+  str[byteQty * 2] = '\0';
+
+  free(bitmap);  bitmap = NULL;
+  *hex = str;
+  return MPA_SUCCESS;
+
+freemem:
+  if (bitmap != NULL) { free(bitmap);  bitmap = NULL; }
+  if (str != NULL) { free(str);  str = NULL; }
+  return mpaRet;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+// Largest number of entries in a SessionDict; indices are one byte on the wire.
+#define SESSION_DICT_MAX_ENTRIES 256
+
+
+typedef struct SessionDict SessionDict;
+
+
+SessionDict* SessionDict_create(uint8_t keyLen);
+MagPebApp_ErrCode SessionDict_destroy(SessionDict* this);
+
+MagPebApp_ErrCode SessionDict_reset(SessionDict* this, uint16_t id);
+uint16_t SessionDict_id(const SessionDict* this);
+MagPebApp_ErrCode SessionDict_define(SessionDict* this, uint8_t idx, const char* key);
+MagPebApp_ErrCode SessionDict_lookup(const SessionDict* this, uint8_t idx, const char** key);
+MagPebApp_ErrCode SessionDict_find(const SessionDict* this, const char* key, uint8_t* idx);
+MagPebApp_ErrCode SessionDict_coverage(const SessionDict* this, const char* keys, char sep, char** hex);
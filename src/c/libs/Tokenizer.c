@@ -0,0 +1,172 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "Tokenizer.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Initializes a Tokenizer over a delimited buffer. No memory is allocated
+/// and the data is not copied; every field handed out by this Tokenizer
+/// points into the caller's buffer.
+/// @param[in,out]  this  Pointer to Tokenizer; may be stack-allocated
+/// @param[in]      data  Pointer to the delimited data. Must stay valid for
+///       as long as fields from this Tokenizer are in use. If fields are
+///       read with Tokenizer_nextStr(), the buffer must be writable and
+///       data[len] must be a null terminator. <em>Ownership is not
+///       transferred to this function.</em>
+/// @param[in]      len  Number of characters of data to tokenize
+/// @param[in]      delim  Field delimiter
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this or data is NULL
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode Tokenizer_init(Tokenizer* this, char* data, size_t len, char delim) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(data);
+
+  this->pos = (len == 0) ? NULL : data;
+  this->end = data + len;
+  this->delim = delim;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether every field of the source buffer has been consumed.
+/////////////////////////////////////////////////////////////////////////////
+bool Tokenizer_done(const Tokenizer* this) {
+  return (this == NULL) || (this->pos == NULL);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether the delimiter at delimPos is escaped, i.e. preceded by
+/// an odd number of escape characters within the current field.
+/////////////////////////////////////////////////////////////////////////////
+static bool Tokenizer_isEscaped(const char* fieldStart, const char* delimPos) {
+  bool escaped = false;
+  while ( (delimPos > fieldStart) && (*(--delimPos) == TOKENIZER_ESCAPE) ) {
+    escaped = !escaped;
+  }
+  return escaped;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Provides the next field as a slice of the source buffer. The buffer is
+/// not modified, so escape sequences are left in the slice; a delimiter
+/// preceded by TOKENIZER_ESCAPE does not end the field.
+/// @param[in,out]  this  Pointer to an initialized Tokenizer
+/// @param[out]     slice  Receives the position and length of the field
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_EMPTY_ERR if there are no fields left
+///          MPA_OVERFLOW_ERR if the field is longer than a slice can hold
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode Tokenizer_nextSlice(Tokenizer* this, StrSlice* slice) {
+  MPA_RETURN_IF_NULL(this);
+  if (this->pos == NULL) { return MPA_EMPTY_ERR; }
+
+  char* fieldEnd = this->pos;
+  while ( ((fieldEnd = memchr(fieldEnd, this->delim, this->end - fieldEnd)) != NULL) &&
+          Tokenizer_isEscaped(this->pos, fieldEnd) ) {
+    fieldEnd++;
+  }
+  char* next = NULL;
+  if (fieldEnd == NULL) {
+    fieldEnd = (char*) this->end;
+  } else {
+    next = fieldEnd + 1;
+  }
+
+  if ((size_t)(fieldEnd - this->pos) > UINT16_MAX) { return MPA_OVERFLOW_ERR; }
+  slice->str = this->pos;
+  slice->len = (uint16_t)(fieldEnd - this->pos);
+  this->pos = next;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Provides the next field as a C-string by overwriting its delimiter with
+/// a null terminator in place. Escape sequences are removed in place too.
+/// @param[in,out]  this  Pointer to an initialized Tokenizer over a
+///       writable, null-terminated buffer
+/// @param[out]     str  Receives a pointer to the field inside the source
+///       buffer. <em>Ownership is not transferred to the caller; the
+///       string is valid for as long as the source buffer is.</em>
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_EMPTY_ERR if there are no fields left
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode Tokenizer_nextStr(Tokenizer* this, char** str) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  StrSlice slice;
+
+  if ( (mpaRet = Tokenizer_nextSlice(this, &slice)) != MPA_SUCCESS) { return mpaRet; }
+  slice.str[slice.len] = '\0';
+
+  char* src = memchr(slice.str, TOKENIZER_ESCAPE, slice.len);
+  if (src != NULL) {
+    char* dst = src;
+    while (*src != '\0') {
+      if ( (*src == TOKENIZER_ESCAPE) && (*(src + 1) != '\0') ) { src++; }
+      *dst++ = *src++;
+    }
+    *dst = '\0';
+  }
+  *str = slice.str;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Parses the next field as an unsigned decimal integer without copying it.
+/// @param[in,out]  this  Pointer to an initialized Tokenizer
+/// @param[out]     value  Receives the parsed value
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this is NULL
+///          MPA_EMPTY_ERR if there are no fields left
+///          MPA_INVALID_INPUT_ERR if the field is empty or not all digits
+///          MPA_OVERFLOW_ERR if the value does not fit in 32 bits
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode Tokenizer_nextUInt32(Tokenizer* this, uint32_t* value) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  StrSlice slice;
+
+  if ( (mpaRet = Tokenizer_nextSlice(this, &slice)) != MPA_SUCCESS) { return mpaRet; }
+  if (slice.len == 0) { return MPA_INVALID_INPUT_ERR; }
+
+  uint32_t num = 0;
+  for (uint16_t idx = 0; idx < slice.len; idx++) {
+    uint8_t digit = (uint8_t)(slice.str[idx] - '0');
+    if (digit > 9) { return MPA_INVALID_INPUT_ERR; }
+    if (num > (UINT32_MAX - digit) / 10) { return MPA_OVERFLOW_ERR; }
+    num = num * 10 + digit;
+  }
+  *value = num;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Parses the next field as an unsigned decimal integer without copying it.
+/// @see Tokenizer_nextUInt32()
+///
+/// @return  MPA_OVERFLOW_ERR if the value does not fit in 16 bits
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode Tokenizer_nextUInt16(Tokenizer* this, uint16_t* value) {
+  MagPebApp_ErrCode mpaRet = MPA_SUCCESS;
+  uint32_t num = 0;
+
+  if ( (mpaRet = Tokenizer_nextUInt32(this, &num)) != MPA_SUCCESS) { return mpaRet; }
+  if (num > UINT16_MAX) { return MPA_OVERFLOW_ERR; }
+  *value = (uint16_t) num;
+  return MPA_SUCCESS;
+}
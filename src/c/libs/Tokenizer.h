@@ -0,0 +1,34 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+// Prefix that makes the next character part of the field, so that free
+// text may contain the delimiter or the escape character itself.
+#define TOKENIZER_ESCAPE '\\'
+
+
+// A length-delimited view of one field inside a Tokenizer's source buffer.
+typedef struct StrSlice {
+  char*    str;             ///< first character of the field (not null-terminated unless terminated in place; still escaped)
+  uint16_t len;             ///< number of characters in the field
+} StrSlice;
+
+
+// Tokenizer is a plain struct so that it can live on the stack; parsing a
+// payload never touches the heap.
+typedef struct Tokenizer {
+  char*       pos;          ///< start of the next field, or NULL when all fields are consumed
+  const char* end;          ///< one past the last character of the source data
+  char        delim;        ///< field delimiter
+} Tokenizer;
+
+
+MagPebApp_ErrCode Tokenizer_init(Tokenizer* this, char* data, size_t len, char delim);
+bool Tokenizer_done(const Tokenizer* this);
+
+MagPebApp_ErrCode Tokenizer_nextSlice(Tokenizer* this, StrSlice*);
+MagPebApp_ErrCode Tokenizer_nextStr(Tokenizer* this, char**);
+MagPebApp_ErrCode Tokenizer_nextUInt32(Tokenizer* this, uint32_t*);
+MagPebApp_ErrCode Tokenizer_nextUInt16(Tokenizer* this, uint16_t*);
@@ -0,0 +1,162 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "TransferSession.h"
+
+
+struct TransferSession {
+  AppTimer*      timer;        ///< idle timeout; NULL while no session is open
+  uint32_t       idleTimeoutMs;
+  uint32_t       startMs;
+  TransferStats  stats;
+  uint16_t       session;      ///< number of the open (or last) session
+  uint8_t        holders;      ///< begin() calls not yet matched by end()
+  TransferReport report;
+  void*          context;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns a millisecond clock suitable for measuring short intervals.
+/////////////////////////////////////////////////////////////////////////////
+static uint32_t TransferSession_nowMs() {
+  time_t secs = 0;
+  uint16_t ms = 0;
+  time_ms(&secs, &ms);
+  return (uint32_t)secs * 1000 + ms;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Closes the open session: restores the normal sniff interval and reports
+/// what the session moved.
+/////////////////////////////////////////////////////////////////////////////
+static void TransferSession_finish(TransferSession* this, bool timedOut) {
+  if (this->timer != NULL) { app_timer_cancel(this->timer);  this->timer = NULL; }
+  this->holders = 0;
+  app_comm_set_sniff_interval(SNIFF_INTERVAL_NORMAL);
+
+  this->stats.durationMs = TransferSession_nowMs() - this->startMs;
+  this->stats.timedOut = timedOut;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "TransferSession %d: %ld bytes in %ld ms", this->session, this->stats.bytes, this->stats.durationMs);
+  if (this->report != NULL) { (*this->report)(&this->stats, this->context); }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Timer callback: nothing was counted for the idle timeout.
+/////////////////////////////////////////////////////////////////////////////
+static void TransferSession_idle(void* data) {
+  TransferSession* this = (TransferSession*) data;
+  this->timer = NULL;
+  TransferSession_finish(this, true);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Constructor
+/// @param[in]      idleTimeoutMs  A session that counts nothing for this
+///       long is ended, whether or not its holders have ended it.
+/// @param[in]      report  Called at the end of each session; may be NULL
+/// @param[in]      context  Passed to report
+/////////////////////////////////////////////////////////////////////////////
+TransferSession* TransferSession_create(uint32_t idleTimeoutMs, TransferReport report, void* context) {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Creating TransferSession [%ld ms]", idleTimeoutMs);
+
+  TransferSession* newTransferSession = malloc(sizeof(*newTransferSession));
+  if (newTransferSession == NULL) { return NULL; }
+
+  newTransferSession->timer = NULL;
+  newTransferSession->idleTimeoutMs = idleTimeoutMs;
+  newTransferSession->startMs = 0;
+  newTransferSession->stats = (TransferStats) { .bytes = 0, .messages = 0, .durationMs = 0, .timedOut = false };
+  newTransferSession->session = 0;
+  newTransferSession->holders = 0;
+  newTransferSession->report = report;
+  newTransferSession->context = context;
+  return newTransferSession;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Destroys TransferSession, ending the open session (if any) first.
+/// @param[in,out]  this  Pointer to TransferSession; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode TransferSession_destroy(TransferSession* this) {
+  MPA_RETURN_IF_NULL(this);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Destroying TransferSession");
+
+  if (this->timer != NULL) { TransferSession_finish(this, false); }
+  free(this); this = NULL;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Holds the session open, opening it if it is not already: the radio is
+/// switched to the reduced sniff interval until the last holder ends it or
+/// it goes idle.
+/// @param[in,out]  this  Pointer to TransferSession; must be already allocated
+/// @param[out]     session  Number of the session held, for
+///       TransferSession_end()
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode TransferSession_begin(TransferSession* this, uint16_t* session) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(session);
+
+  if (this->timer == NULL) {
+    if ( (this->timer = app_timer_register(this->idleTimeoutMs, TransferSession_idle, this)) == NULL) {
+      return MPA_OUT_OF_MEMORY_ERR;
+    }
+    this->session++;
+    this->startMs = TransferSession_nowMs();
+    this->stats = (TransferStats) { .bytes = 0, .messages = 0, .durationMs = 0, .timedOut = false };
+    app_comm_set_sniff_interval(SNIFF_INTERVAL_REDUCED);
+  }
+  if (this->holders < UINT8_MAX) { this->holders++; }
+  *session = this->session;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Releases a hold on the session; the session ends with its last holder.
+/// A hold on a session that has since timed out is ignored.
+/// @param[in,out]  this  Pointer to TransferSession; must be already allocated
+/// @param[in]      session  Number returned by TransferSession_begin()
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode TransferSession_end(TransferSession* this, uint16_t session) {
+  MPA_RETURN_IF_NULL(this);
+
+  if ( (this->timer == NULL) || (session != this->session) || (this->holders == 0) ) { return MPA_SUCCESS; }
+  if (--this->holders == 0) { TransferSession_finish(this, false); }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Counts one message towards the open session and restarts its idle
+/// timeout. Does nothing while no session is open.
+/// @param[in,out]  this  Pointer to TransferSession; must be already allocated
+/// @param[in]      bytes  Size of the message
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode TransferSession_count(TransferSession* this, size_t bytes) {
+  MPA_RETURN_IF_NULL(this);
+
+  if (this->timer == NULL) { return MPA_SUCCESS; }
+  this->stats.bytes += bytes;
+  if (this->stats.messages < UINT16_MAX) { this->stats.messages++; }
+  app_timer_reschedule(this->timer, this->idleTimeoutMs);
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether a session is open.
+/////////////////////////////////////////////////////////////////////////////
+bool TransferSession_active(const TransferSession* this) {
+  return (this != NULL) && (this->timer != NULL);
+}
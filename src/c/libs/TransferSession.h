@@ -0,0 +1,30 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+typedef struct TransferSession TransferSession;
+
+
+// What one session moved, and how long the radio was kept in the reduced
+// sniff interval for it.
+typedef struct TransferStats {
+  uint32_t bytes;           ///< message bytes counted during the session
+  uint16_t messages;        ///< messages counted during the session
+  uint32_t durationMs;      ///< time from the first holder's begin to the end
+  bool     timedOut;        ///< ended because nothing was counted for the idle timeout
+} TransferStats;
+
+// TransferReport is a pointer to a function that is called once at the end
+// of each session.
+typedef void (*TransferReport)(const TransferStats* stats, void* context);
+
+
+TransferSession* TransferSession_create(uint32_t idleTimeoutMs, TransferReport report, void* context);
+MagPebApp_ErrCode TransferSession_destroy(TransferSession* this);
+
+MagPebApp_ErrCode TransferSession_begin(TransferSession* this, uint16_t* session);
+MagPebApp_ErrCode TransferSession_end(TransferSession* this, uint16_t session);
+MagPebApp_ErrCode TransferSession_count(TransferSession* this, size_t bytes);
+bool TransferSession_active(const TransferSession* this);
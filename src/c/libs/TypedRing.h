@@ -0,0 +1,126 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+// Largest capacity of a ring sized at run time; its positions are uint16_t.
+#define TYPED_RING_MAX_CAPACITY 0x8000
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Defines a FIFO ring of TYPE elements, named NAME, that stores up to
+/// CAPACITY elements inline: a ring is a plain struct, so it can be
+/// embedded in whatever owns it and needs no allocation of its own.
+///
+/// CAPACITY must be a power of two (a ring will not compile otherwise), so
+/// that positions wrap with a mask instead of a division. The element count
+/// is kept apart from the read position, so every slot can be used.
+///
+/// The ring's functions are static inline, and follow the RingBuffer API:
+///   NAME_init(this)                 empties the ring
+///   NAME_count(this), NAME_empty(this), NAME_full(this)
+///   NAME_at(this, idx)              element at position idx; NULL if none
+///   NAME_push(this, item)           appends a copy; MPA_FULL_ERR if full
+///   NAME_pop(this, out)             removes the first; out may be NULL
+///   NAME_removeAt(this, idx, out)   removes one, moving those behind it
+///       forward; out may be NULL
+/// Like the rest of the libraries, they return MPA_EMPTY_ERR for a position
+/// that holds no element.
+/////////////////////////////////////////////////////////////////////////////
+#define TYPED_RING_DEFINE(NAME, TYPE, CAPACITY)                                                     \
+  typedef char NAME##_capacityIsPowerOfTwo[( ((CAPACITY) > 0) && (((CAPACITY) & ((CAPACITY) - 1)) == 0) ) ? 1 : -1]; \
+                                                                                                    \
+  typedef struct NAME {                                                                             \
+    uint16_t read;                                                                                  \
+    uint16_t count;                                                                                 \
+    TYPE     items[CAPACITY];                                                                       \
+  } NAME;                                                                                           \
+                                                                                                    \
+  static inline void NAME##_init(NAME* this) {                                                      \
+    this->read = 0;                                                                                 \
+    this->count = 0;                                                                                \
+  }                                                                                                 \
+                                                                                                    \
+  TYPED_RING_FUNCTIONS(NAME, TYPE, (CAPACITY), ((CAPACITY) - 1))
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Defines a FIFO ring of TYPE elements, named NAME, whose capacity is set
+/// at run time. Its slots belong to the owner, which allocates them along
+/// with itself (a flexible array member, say) so that the ring still costs
+/// no allocation of its own:
+///   NAME_slotQty(capacity)          slots to provide for that capacity: the
+///       capacity rounded up to a power of two; 0 if it is zero or above
+///       TYPED_RING_MAX_CAPACITY
+///   NAME_init(this, slots, capacity)  empties the ring over those slots;
+///       MPA_INVALID_INPUT_ERR if slotQty() rejects the capacity
+/// The other functions are those of TYPED_RING_DEFINE, and full() compares
+/// the count against the capacity rather than the number of slots.
+/////////////////////////////////////////////////////////////////////////////
+#define TYPED_RING_DEFINE_SIZED(NAME, TYPE)                                                         \
+  typedef struct NAME {                                                                             \
+    uint16_t read;                                                                                  \
+    uint16_t count;                                                                                 \
+    uint16_t capacity;                                                                              \
+    uint16_t mask;                                                                                  \
+    TYPE*    items;                                                                                 \
+  } NAME;                                                                                           \
+                                                                                                    \
+  static inline size_t NAME##_slotQty(size_t capacity) {                                            \
+    if ( (capacity == 0) || (capacity > TYPED_RING_MAX_CAPACITY) ) { return 0; }                    \
+    size_t slotQty = 1;                                                                             \
+    while (slotQty < capacity) { slotQty <<= 1; }                                                   \
+    return slotQty;                                                                                 \
+  }                                                                                                 \
+                                                                                                    \
+  static inline MagPebApp_ErrCode NAME##_init(NAME* this, TYPE* slots, size_t capacity) {          \
+    size_t slotQty = NAME##_slotQty(capacity);                                                      \
+    if (slotQty == 0) { return MPA_INVALID_INPUT_ERR; }                                             \
+    this->read = 0;                                                                                 \
+    this->count = 0;                                                                                \
+    this->capacity = capacity;                                                                      \
+    this->mask = slotQty - 1;                                                                       \
+    this->items = slots;                                                                            \
+    return MPA_SUCCESS;                                                                             \
+  }                                                                                                 \
+                                                                                                    \
+  TYPED_RING_FUNCTIONS(NAME, TYPE, this->capacity, this->mask)
+
+
+// Functions shared by both kinds of ring; CAPACITY and MASK are expressions
+// that may refer to this.
+#define TYPED_RING_FUNCTIONS(NAME, TYPE, CAPACITY, MASK)                                            \
+  static inline uint16_t NAME##_count(const NAME* this) { return this->count; }                     \
+  static inline bool NAME##_empty(const NAME* this) { return (this->count == 0); }                  \
+  static inline bool NAME##_full(const NAME* this) { return (this->count >= (CAPACITY)); }          \
+                                                                                                    \
+  static inline TYPE* NAME##_at(NAME* this, size_t idx) {                                           \
+    if (idx >= this->count) { return NULL; }                                                        \
+    return &this->items[(this->read + idx) & (MASK)];                                               \
+  }                                                                                                 \
+                                                                                                    \
+  static inline MagPebApp_ErrCode NAME##_push(NAME* this, TYPE item) {                              \
+    if (this->count >= (CAPACITY)) { return MPA_FULL_ERR; }                                         \
+    this->items[(this->read + this->count) & (MASK)] = item;                                        \
+    this->count++;                                                                                  \
+    return MPA_SUCCESS;                                                                             \
+  }                                                                                                 \
+                                                                                                    \
+  static inline MagPebApp_ErrCode NAME##_pop(NAME* this, TYPE* out) {                               \
+    if (this->count == 0) { return MPA_EMPTY_ERR; }                                                 \
+    if (out != NULL) { *out = this->items[this->read]; }                                            \
+    this->read = (this->read + 1) & (MASK);                                                         \
+    this->count--;                                                                                  \
+    return MPA_SUCCESS;                                                                             \
+  }                                                                                                 \
+                                                                                                    \
+  static inline MagPebApp_ErrCode NAME##_removeAt(NAME* this, size_t idx, TYPE* out) {              \
+    if (idx >= this->count) { return MPA_EMPTY_ERR; }                                               \
+    if (out != NULL) { *out = this->items[(this->read + idx) & (MASK)]; }                           \
+    for (size_t pos=idx; pos+1<this->count; pos++) {                                                \
+      this->items[(this->read + pos) & (MASK)] = this->items[(this->read + pos + 1) & (MASK)];      \
+    }                                                                                               \
+    this->count--;                                                                                  \
+    return MPA_SUCCESS;                                                                             \
+  }
@@ -106,6 +106,7 @@ freemem:
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 static uint16_t WndDataMenu_getNumSectionsCallback(MenuLayer* menu_layer, void* callback_context) {
+  (void) menu_layer;
   WndDataMenu* this = (WndDataMenu*) callback_context;
   if (this == NULL) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Attempted operation on NULL pointer.");   \
@@ -119,6 +120,7 @@ static uint16_t WndDataMenu_getNumSectionsCallback(MenuLayer* menu_layer, void*
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 static uint16_t WndDataMenu_getNumRowsCallback(MenuLayer* menu_layer, uint16_t section_index, void* callback_context) {
+  (void) menu_layer;
   WndDataMenu* this = (WndDataMenu*) callback_context;
   if (this == NULL) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Attempted operation on NULL pointer.");   \
@@ -197,6 +199,8 @@ static void WndDataMenu_drawHeaderCallback(GContext* ctx, const Layer* cell_laye
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 static void WndDataMenu_selectCallback(MenuLayer* menu_layer, MenuIndex* cell_index, void* callback_context) {
+  (void) menu_layer;
+  (void) cell_index;
   WndDataMenu* this = (WndDataMenu*) callback_context;
   if (this == NULL) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Attempted operation on NULL pointer.");
@@ -227,6 +231,7 @@ static int16_t WndDataMenu_getCellHeightCallback(MenuLayer* menu_layer, MenuInde
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 static int16_t WndDataMenu_getHeaderHeightCallback(MenuLayer* menu_layer, uint16_t sectIdx, void* callback_context) {
+  (void) menu_layer;
   WndDataMenu* this = (WndDataMenu*) callback_context;
   if (this == NULL) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Attempted operation on NULL pointer.");
@@ -0,0 +1,202 @@
+#include <pebble.h>
+
+// Deactivate APP_LOG in this file.
+#undef APP_LOG
+#define APP_LOG(...)
+
+#include "WorkQueue.h"
+
+
+typedef struct WorkJob {
+  struct WorkJob* next;
+  WorkStep        step;
+  WorkDone        done;
+  void*           context;
+  const void*     tag;       ///< identifies related jobs for WorkQueue_cancel()
+} WorkJob;
+
+
+struct WorkQueue {
+  WorkJob*  head;
+  WorkJob*  tail;
+  AppTimer* timer;
+  uint16_t  sliceMs;         ///< maximum time spent working per timer callback
+  uint16_t  yieldMs;         ///< time handed back to the event loop between slices
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns a millisecond clock suitable for measuring short intervals.
+/////////////////////////////////////////////////////////////////////////////
+static uint32_t WorkQueue_nowMs() {
+  time_t secs = 0;
+  uint16_t ms = 0;
+  time_ms(&secs, &ms);
+  return (uint32_t)secs * 1000 + ms;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Removes the first job from the queue and reports its completion.
+/////////////////////////////////////////////////////////////////////////////
+static void WorkQueue_finishHead(WorkQueue* this, MagPebApp_ErrCode result, bool cancelled) {
+  WorkJob* job = this->head;
+  this->head = job->next;
+  if (this->head == NULL) { this->tail = NULL; }
+
+  if (job->done != NULL) { (*job->done)(job->context, result, cancelled); }
+  free(job);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Timer callback: runs job steps until the slice budget is spent, then
+/// yields to the event loop and reschedules itself if work remains.
+/////////////////////////////////////////////////////////////////////////////
+static void WorkQueue_runSlice(void* data) {
+  WorkQueue* this = (WorkQueue*) data;
+  this->timer = NULL;
+
+  uint32_t start = WorkQueue_nowMs();
+  while (this->head != NULL) {
+    bool done = false;
+    MagPebApp_ErrCode result = (*this->head->step)(this->head->context, &done);
+    if (done || (result != MPA_SUCCESS)) {
+      WorkQueue_finishHead(this, result, false);
+    }
+    if ((uint32_t)(WorkQueue_nowMs() - start) >= this->sliceMs) { break; }
+  }
+
+  if ( (this->head != NULL) && (this->timer == NULL) ) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "WorkQueue yielding after %ld ms", WorkQueue_nowMs() - start);
+    this->timer = app_timer_register(this->yieldMs, WorkQueue_runSlice, this);
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Constructor
+/// @param[in]      sliceMs  Time budget for each slice of work. A step is
+///       never interrupted, so a slice ends after the first step that
+///       reaches the budget.
+/// @param[in]      yieldMs  Delay between slices, during which the event
+///       loop can process input and redraw.
+/////////////////////////////////////////////////////////////////////////////
+WorkQueue* WorkQueue_create(uint16_t sliceMs, uint16_t yieldMs) {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Creating WorkQueue [%d/%d ms]", sliceMs, yieldMs);
+
+  WorkQueue* newWorkQueue = malloc(sizeof(*newWorkQueue));
+  if (newWorkQueue == NULL) { return NULL; }
+
+  newWorkQueue->head = NULL;
+  newWorkQueue->tail = NULL;
+  newWorkQueue->timer = NULL;
+  newWorkQueue->sliceMs = sliceMs;
+  newWorkQueue->yieldMs = yieldMs;
+  return newWorkQueue;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Destroys WorkQueue, cancelling every job that has not finished.
+/// @param[in,out]  this  Pointer to WorkQueue; must be already allocated
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode WorkQueue_destroy(WorkQueue* this) {
+  MPA_RETURN_IF_NULL(this);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Destroying WorkQueue");
+
+  if (this->timer != NULL) { app_timer_cancel(this->timer);  this->timer = NULL; }
+  while (this->head != NULL) {
+    WorkQueue_finishHead(this, MPA_SUCCESS, true);
+  }
+
+  free(this); this = NULL;
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Adds a job to the end of the queue. Jobs run one at a time, in the
+/// order they were enqueued; the first slice runs from the event loop,
+/// not from within this call.
+/// @param[in,out]  this  Pointer to WorkQueue; must be already allocated
+/// @param[in]      step  Performs one bounded unit of the job's work
+/// @param[in]      done  Called once when the job finishes or is cancelled;
+///       may be NULL
+/// @param[in]      context  Passed to step and done. <em>Ownership is not
+///       transferred; done is the place to release it.</em>
+/// @param[in]      tag  Identifies the job for WorkQueue_cancel(); may be
+///       NULL
+///
+/// @return  MPA_SUCCESS on success
+///          MPA_NULL_POINTER_ERR if this or step is NULL
+///          MPA_OUT_OF_MEMORY_ERR if a memory allocation fails
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode WorkQueue_enqueue(WorkQueue* this, WorkStep step, WorkDone done, void* context, const void* tag) {
+  MPA_RETURN_IF_NULL(this);
+  MPA_RETURN_IF_NULL(step);
+
+  WorkJob* job = malloc(sizeof(*job));
+  if (job == NULL) { return MPA_OUT_OF_MEMORY_ERR; }
+  job->next = NULL;
+  job->step = step;
+  job->done = done;
+  job->context = context;
+  job->tag = tag;
+
+  if (this->tail == NULL) {
+    this->head = job;
+  } else {
+    this->tail->next = job;
+  }
+  this->tail = job;
+
+  if (this->timer == NULL) {
+    this->timer = app_timer_register(0, WorkQueue_runSlice, this);
+  }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Cancels every unfinished job with the specified tag. Each cancelled
+/// job's done function is called with cancelled set to true.
+/// @param[in,out]  this  Pointer to WorkQueue; must be already allocated
+/// @param[in]      tag  Tag that was passed to WorkQueue_enqueue()
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode WorkQueue_cancel(WorkQueue* this, const void* tag) {
+  MPA_RETURN_IF_NULL(this);
+
+  WorkJob** link = &this->head;
+  WorkJob* prev = NULL;
+  while (*link != NULL) {
+    WorkJob* job = *link;
+    if (job->tag != tag) {
+      prev = job;
+      link = &job->next;
+      continue;
+    }
+
+    *link = job->next;
+    if (this->tail == job) { this->tail = prev; }
+    if (job->done != NULL) { (*job->done)(job->context, MPA_SUCCESS, true); }
+    free(job);
+  }
+
+  if ( (this->head == NULL) && (this->timer != NULL) ) {
+    app_timer_cancel(this->timer);  this->timer = NULL;
+  }
+  return MPA_SUCCESS;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether the WorkQueue has no unfinished jobs.
+/// @param[in,out]  this  Pointer to WorkQueue; must be already allocated
+/// @param[out]     out  Pointer to boolean (true if empty)
+/////////////////////////////////////////////////////////////////////////////
+MagPebApp_ErrCode WorkQueue_empty(WorkQueue* this, bool* out) {
+  MPA_RETURN_IF_NULL(this);
+  *out = (this->head == NULL);
+  return MPA_SUCCESS;
+}
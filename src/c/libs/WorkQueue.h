@@ -0,0 +1,26 @@
+#pragma once
+
+#include <pebble.h>
+#include "magpebapp.h"
+
+
+typedef struct WorkQueue WorkQueue;
+
+
+// WorkStep is a pointer to a function that performs one bounded unit of a
+// job's work and sets done to true once the job has finished. It is
+// called repeatedly, across timer callbacks, until then.
+typedef MagPebApp_ErrCode (*WorkStep)(void* context, bool* done);
+
+// WorkDone is a pointer to a function that is called exactly once per job,
+// when it has finished or has been cancelled, so that it can act on the
+// result and release its context.
+typedef void (*WorkDone)(void* context, MagPebApp_ErrCode result, bool cancelled);
+
+
+WorkQueue* WorkQueue_create(uint16_t sliceMs, uint16_t yieldMs);
+MagPebApp_ErrCode WorkQueue_destroy(WorkQueue* this);
+
+MagPebApp_ErrCode WorkQueue_enqueue(WorkQueue* this, WorkStep, WorkDone, void* context, const void* tag);
+MagPebApp_ErrCode WorkQueue_cancel(WorkQueue* this, const void* tag);
+MagPebApp_ErrCode WorkQueue_empty(WorkQueue* this, bool*);
@@ -16,9 +16,130 @@ var kivaAppId = 'com.magnosity.global-lender';
 var kivaAppIdParam = "appId=" + kivaAppId;
 
 
-// Global variable to store results from multi-page API calls
-// Stored with keys equal to the page number (eg. range = [1 .. n pages])
-var pageArray = [];
+// Record sets (countries, loans) are sent to the watch as packed binary
+// records. When false, the "|"-delimited text encoding is used instead.
+var binaryRecordSets = true;
+
+// Protocol version sent in PEBKIT_READY; must match PROTOCOL_VERSION in
+// comm.c. Scripts that predate the handshake send 1.
+var protocolVersion = 2;
+
+// Optional wire encodings; the bits must match ProtocolCaps in comm.c.
+// Each side announces those it supports in PROTOCOL_CAPS, and only those
+// that both support are used. A watch that predates the handshake
+// announces none and is sent the "|"-delimited text protocol: whole record
+// sets in single messages, without deltas or dictionary indices.
+var CAP_BINARY_RECORDS = 1 << 0;
+var CAP_CHUNKED        = 1 << 1;
+var CAP_DELTA_SYNC     = 1 << 2;
+var CAP_COUNTRY_DICT   = 1 << 3;
+var CAP_NOT_MODIFIED   = 1 << 4;
+var CAP_BATCHED        = 1 << 5;
+var localCaps = (binaryRecordSets ? CAP_BINARY_RECORDS : 0) | CAP_CHUNKED | CAP_DELTA_SYNC | CAP_COUNTRY_DICT | CAP_NOT_MODIFIED |
+    CAP_BATCHED;
+var watchCaps = 0;
+
+// Parts of the answers that are tagged with a DATA_TAG: the part in the
+// top four bits and a hash of its content in the rest. The numbers must
+// match DataPart in comm.c. The watch makes a request conditional by
+// appending "#<tag>.<tag>..." (in hex) to it, and each part whose content
+// still hashes to one of those tags is answered with NOT_MODIFIED instead.
+var PART_LENDER_PROFILE = 1;
+var PART_LENDER_LOANS   = 2;
+var PART_LOAN_SET       = 3;
+
+// Record sets are split into chunks of whole records, each small enough to
+// fit in the watch's AppMessage inbox along with its chunk header. The watch
+// advertises its inbox size (INBOX_SIZE) when it connects, and asks for
+// smaller chunks (CHUNK_SIZE) if one is dropped anyway.
+var maxChunkBytes = 1000;
+
+// Identifies each chunked transfer; the watch uses it to tell a new
+// transfer from a chunk of the current one.
+var nextTransferId = 1;
+
+// The chunks of the most recent transfer of each record-set key, kept so
+// that chunks the watch missed can be sent again (CHUNK_RESEND).
+var sentTransfers = {};
+
+// What was last sent of each delta-synced record set during this session:
+// its generation, scope and records by key. Later sends of the same set
+// carry only the differences.
+var syncStates = {};
+var nextSyncGen = 1;
+
+// Deltas sent in a row before a full set is sent again, which lets the
+// watch release the storage of replaced and removed records.
+var maxDeltasPerGen = 8;
+
+// Dictionary keys that are copied into every chunk of a transfer.
+var chunkHeaderKeys = ["SYNC_GEN", "SYNC_BASE_GEN", "REQUEST_ID", "DICT_ID"];
+
+// Session dictionary of countries. Every country record carries the index
+// the country has here, and later messages in either direction name
+// countries by index: the watch asks for loans with a coverage bitmap, and
+// a lender's countries are sent as one (LENDER_COUNTRY_MAP) once the watch
+// has them all. The ID tells this session's indices from an earlier one's.
+var countryDict = {
+  id: 1 + Math.floor(Math.random() * 0xFFFF),
+  idxByCode: {},
+  codes: [],
+  defined: {}     // indices whose records the watch has acknowledged
+};
+var countryDictMax = 256;
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns whether both the watch and this script support a capability.
+/////////////////////////////////////////////////////////////////////////////
+function usesCap(cap) {
+  return (localCaps & watchCaps & cap) !== 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the DATA_TAG of an answer: the part, and an FNV-1a hash of the
+/// dictionary's keys and values. Record sets are hashed by scope and
+/// records.
+/// @param[in]      part  PART_* constant
+/// @param[in]      dictionary  Answer as parsed, before it is synced or
+///       split into chunks
+/////////////////////////////////////////////////////////////////////////////
+function dataTag(part, dictionary) {
+  var text = "";
+  var keys = Object.keys(dictionary).sort();
+  for (var kidx = 0; kidx < keys.length; kidx++) {
+    var value = dictionary[keys[kidx]];
+    if (value instanceof RecordSet) value = value.scope + "|" + value.records.join("|");
+    text += keys[kidx] + "=" + value + ";";
+  }
+
+  var hash = 0x811c9dc5;
+  for (var cidx = 0; cidx < text.length; cidx++) {
+    hash ^= text.charCodeAt(cidx);
+    hash = (hash + (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24)) >>> 0;
+  }
+  return ((part << 28) | (hash & 0x0FFFFFFF)) >>> 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Splits a conditional request into its payload and the DATA_TAGs the
+/// watch holds.
+/// @return  { payload, tags } where tags maps each part to its tag
+/////////////////////////////////////////////////////////////////////////////
+function splitDataTags(request) {
+  var parts = String(request).split("#");
+  var tags = {};
+  if (parts.length > 1) {
+    var hexTags = parts[1].split(".");
+    for (var tidx = 0; tidx < hexTags.length; tidx++) {
+      var tag = parseInt(hexTags[tidx], 16);
+      if (tag > 0) tags[tag >>> 28] = tag;
+    }
+  }
+  return { payload: parts[0], tags: tags };
+}
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -35,6 +156,528 @@ Array.prototype.unique = function() {
 };
 
 
+/////////////////////////////////////////////////////////////////////////////
+/// Escapes a free-text field for a "|"-delimited record set: backslashes
+/// and pipes are prefixed with a backslash, which the watch's Tokenizer
+/// removes again.
+/////////////////////////////////////////////////////////////////////////////
+function escapeField(value) {
+  return String(value).replace(/[\\|]/g, "\\$&");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Clamps a number to the range of an unsigned 16-bit integer.
+/////////////////////////////////////////////////////////////////////////////
+function toUInt16(value) {
+  return Math.max(0, Math.min(Math.round(Number(value)) || 0, 0xFFFF));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Appends an unsigned integer to a byte array, little-endian.
+/// @param[in,out]  bytes  Byte array to append to
+/// @param[in]      value  Integer to append
+/// @param[in]      byteQty  Width of the integer in bytes (2 or 4)
+/////////////////////////////////////////////////////////////////////////////
+function packUInt(bytes, value, byteQty) {
+  for (var i = 0; i < byteQty; i++) {
+    bytes.push(value & 0xFF);
+    value = value >>> 8;
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Appends a string to a byte array as a one-byte length followed by its
+/// UTF-8 bytes. Strings over 255 bytes are truncated on a character
+/// boundary.
+/////////////////////////////////////////////////////////////////////////////
+function packStr(bytes, value) {
+  var utf8 = unescape(encodeURIComponent(String(value)));
+  var len = Math.min(utf8.length, 255);
+  while (len > 0 && len < utf8.length && (utf8.charCodeAt(len) & 0xC0) === 0x80) len--;
+
+  bytes.push(len);
+  for (var i = 0; i < len; i++) bytes.push(utf8.charCodeAt(i));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Appends a two-character country code to a byte array as two bytes.
+/////////////////////////////////////////////////////////////////////////////
+function packCC(bytes, value) {
+  bytes.push(value.charCodeAt(0) & 0xFF, value.charCodeAt(1) & 0xFF);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Prefixes the fields of one binary record with their length as a
+/// little-endian uint16.
+/////////////////////////////////////////////////////////////////////////////
+function packRecord(fields) {
+  var record = [];
+  packUInt(record, fields.length, 2);
+  for (var i = 0; i < fields.length; i++) record.push(fields[i]);
+  return record;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// A record set ready to be sent: an array of encoded records, each a byte
+/// array (binary) or a "|"-delimited string (text). Dictionary values of
+/// this type are split into chunks by sendDictionary().
+/// @param[in]      records  Encoded records
+/// @param[in]      keys  Encoded key field of each record, in the same
+///       order; if given, the set is delta-synced
+/// @param[in]      scope  Identifies what the set describes (such as the
+///       lender); a set with a different scope is never sent as a delta
+/////////////////////////////////////////////////////////////////////////////
+function RecordSet(records, keys, scope) {
+  this.records = records;
+  this.keys = keys;
+  this.scope = scope;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the session dictionary index of a country, assigning the next
+/// free one if the country has none yet.
+/////////////////////////////////////////////////////////////////////////////
+function countryIdx(code) {
+  if (!countryDict.idxByCode.hasOwnProperty(code)) {
+    if (countryDict.codes.length >= countryDictMax) return undefined;
+    countryDict.idxByCode[code] = countryDict.codes.length;
+    countryDict.codes.push(code);
+  }
+  return countryDict.idxByCode[code];
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Encodes a set of countries as a coverage bitmap of their dictionary
+/// indices: bit (idx % 8) of byte (idx / 8).
+/// @param[in]      codes  Country codes
+/// @return  Byte array, or null unless there are countries and the watch
+///       has every one of them
+/////////////////////////////////////////////////////////////////////////////
+function countryCoverage(codes) {
+  if (!usesCap(CAP_COUNTRY_DICT) || !usesCap(CAP_BINARY_RECORDS) || codes.length === 0) return null;
+  var bitmap = [];
+  for (var cidx = 0; cidx < codes.length; cidx++) {
+    var idx = countryDict.idxByCode[codes[cidx]];
+    if (idx === undefined || !countryDict.defined[idx]) return null;
+    while (bitmap.length <= (idx >> 3)) bitmap.push(0);
+    bitmap[idx >> 3] |= 1 << (idx & 7);
+  }
+  return bitmap;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Decodes a country list sent by the watch: either country codes
+/// separated by commas, or "<dictionary ID>:<coverage bitmap>" in hex.
+/// @return  Comma-separated country codes, or null if the watch coded the
+///       list against a dictionary other than this session's
+/////////////////////////////////////////////////////////////////////////////
+function decodeCountryList(list) {
+  var coded = /^([0-9a-f]{4}):([0-9a-f]*)$/.exec(String(list));
+  if (!coded) return list;
+  if (parseInt(coded[1], 16) !== countryDict.id) return null;
+
+  var codes = [];
+  for (var bidx = 0; bidx * 2 < coded[2].length; bidx++) {
+    var bits = parseInt(coded[2].substr(bidx * 2, 2), 16);
+    for (var bit = 0; bit < 8; bit++) {
+      if ((bits & (1 << bit)) && countryDict.codes[bidx * 8 + bit] !== undefined) codes.push(countryDict.codes[bidx * 8 + bit]);
+    }
+  }
+  return codes.join(",");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Encodes a country set (KIVA_COUNTRY_SET or LENDER_COUNTRY_SET).
+/// Record layout must match COUNTRY_FIELDS in comm.c.
+/// @param[in]      countries  Object mapping country codes to names
+/// @param[in]      scope  Scope for delta sync; if undefined, the set is
+///       sent in full every time
+/////////////////////////////////////////////////////////////////////////////
+function encodeCountrySet(countries, scope) {
+  var records = [];
+  var keys = [];
+  var defines = [];
+  for (var key in countries) {
+    if (countries.hasOwnProperty(key)) {
+      // Without dictionary support, records end before the index.
+      var idx = usesCap(CAP_COUNTRY_DICT) ? countryIdx(key) : null;
+      if (idx === undefined) continue;
+      if (idx !== null) defines.push(idx);
+      var fields = [];
+      if (usesCap(CAP_BINARY_RECORDS)) {
+        packCC(fields, key);
+        keys.push(packRecord(fields));
+        packStr(fields, countries[key]);
+        if (idx !== null) fields.push(idx);
+        records.push(packRecord(fields));
+      } else {
+        keys.push(key);
+        records.push(key + "|" + escapeField(countries[key]) + (idx !== null ? "|" + idx : ""));
+      }
+    }
+  }
+  var recordSet = new RecordSet(records, (scope === undefined) ? undefined : keys, scope);
+  recordSet.defines = defines;
+  return recordSet;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Encodes a LOAN_SET. Record layout must match LOAN_FIELDS in comm.c.
+/// @param[in]      loans  Array of loans from the Kiva API
+/////////////////////////////////////////////////////////////////////////////
+function encodeLoanSet(loans) {
+  var records = [];
+  var keys = [];
+  for (var lidx = 0; lidx < loans.length; lidx++) {
+    var loan = loans[lidx];
+    if (usesCap(CAP_BINARY_RECORDS)) {
+      var fields = [];
+      packUInt(fields, loan.id, 4);
+      keys.push(packRecord(fields));
+      packStr(fields, loan.name);
+      packStr(fields, loan.use);
+      packCC(fields, loan.location.country_code);
+      packUInt(fields, toUInt16(loan.funded_amount), 2);
+      packUInt(fields, toUInt16(loan.loan_amount), 2);
+      records.push(packRecord(fields));
+    } else {
+      keys.push(String(loan.id));
+      records.push(
+          loan.id +                        "|" +
+          escapeField(loan.name) +         "|" +
+          escapeField(loan.use) +          "|" +
+          loan.location.country_code +     "|" +
+          toUInt16(loan.funded_amount) +   "|" +
+          toUInt16(loan.loan_amount));
+    }
+  }
+  return new RecordSet(records, keys, "");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Joins encoded records into one chunk payload.
+/////////////////////////////////////////////////////////////////////////////
+function joinRecords(records) {
+  if (!usesCap(CAP_BINARY_RECORDS)) return records.join("|");
+
+  var bytes = [];
+  for (var ridx = 0; ridx < records.length; ridx++) {
+    for (var bidx = 0; bidx < records[ridx].length; bidx++) bytes.push(records[ridx][bidx]);
+  }
+  return bytes;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the number of bytes an encoded record occupies in a message.
+/////////////////////////////////////////////////////////////////////////////
+function recordSize(record) {
+  if (usesCap(CAP_BINARY_RECORDS)) return record.length;
+  return unescape(encodeURIComponent(record)).length + 1;   // plus delimiter
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Returns the number of bytes a dictionary occupies in an AppMessage,
+/// counted the way dict_calc_buffer_size() does on the watch.
+/////////////////////////////////////////////////////////////////////////////
+function dictSize(dictionary) {
+  var size = 1;
+  for (var key in dictionary) {
+    if (!dictionary.hasOwnProperty(key)) continue;
+    var value = dictionary[key];
+    if (typeof value === "number") size += 7 + 4;
+    else if (value instanceof Array) size += 7 + value.length;
+    else size += 7 + unescape(encodeURIComponent(String(value))).length + 1;
+  }
+  return size;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Drops records from the end of a record set until the rest fit in the
+/// specified number of bytes. The first record is always kept.
+/// @param[in,out]  recordSet  RecordSet to trim
+/// @param[in]      maxBytes  Space available for the records
+/// @return  recordSet
+/////////////////////////////////////////////////////////////////////////////
+function fitRecordSet(recordSet, maxBytes) {
+  var bytes = 0;
+  var qty = 0;
+  while (qty < recordSet.records.length && (qty === 0 || bytes + recordSize(recordSet.records[qty]) <= maxBytes)) {
+    bytes += recordSize(recordSet.records[qty]);
+    qty++;
+  }
+  if (qty < recordSet.records.length) {
+    console.log("Trimming record set from " + recordSet.records.length + " to " + qty + " records to fit " + maxBytes + " bytes");
+    recordSet.records = recordSet.records.slice(0, qty);
+    if (recordSet.keys) recordSet.keys = recordSet.keys.slice(0, qty);
+  }
+  return recordSet;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Replaces a delta-synced record set in a dictionary with what the watch
+/// needs to catch up: the full set tagged with a new SYNC_GEN, or only the
+/// added and changed records plus the keys of removed ones
+/// (SYNC_REMOVE_SET), tagged with SYNC_BASE_GEN as well.
+/// @param[in,out]  dictionary  Dictionary about to be sent
+/// @param[in]      setKey  Key of the RecordSet value in dictionary
+/////////////////////////////////////////////////////////////////////////////
+function syncRecordSet(dictionary, setKey) {
+  var recordSet = dictionary[setKey];
+  if (!recordSet.keys) return;
+
+  var prev = syncStates[setKey];
+  var byKey = {};
+  var id;
+  for (var ridx = 0; ridx < recordSet.records.length; ridx++) {
+    byKey[String(recordSet.keys[ridx])] = { record: recordSet.records[ridx], key: recordSet.keys[ridx] };
+  }
+
+  var full = !prev || prev.mapped || prev.scope !== recordSet.scope || prev.deltaQty >= maxDeltasPerGen;
+  var upserts = [];
+  var removes = [];
+  if (!full) {
+    for (id in byKey) {
+      if (byKey.hasOwnProperty(id) && (!prev.byKey.hasOwnProperty(id) || String(prev.byKey[id].record) !== String(byKey[id].record))) {
+        upserts.push(byKey[id].record);
+      }
+    }
+    for (id in prev.byKey) {
+      if (prev.byKey.hasOwnProperty(id) && !byKey.hasOwnProperty(id)) removes.push(prev.byKey[id].key);
+    }
+    // A delta that replaces everything saves nothing.
+    full = (recordSet.records.length > 0 && upserts.length === recordSet.records.length);
+  }
+
+  var gen = nextSyncGen++;
+  dictionary.SYNC_GEN = gen;
+  if (!full) {
+    console.log(setKey + " delta " + prev.gen + " -> " + gen + ": " + upserts.length + " changed, " + removes.length + " removed");
+    dictionary.SYNC_BASE_GEN = prev.gen;
+    dictionary[setKey] = new RecordSet(upserts);
+    if (removes.length > 0) dictionary.SYNC_REMOVE_SET = joinRecords(removes);
+  }
+  syncStates[setKey] = { gen: gen, scope: recordSet.scope, byKey: byKey, deltaQty: full ? 0 : prev.deltaQty + 1 };
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Sends the full current generation of a delta-synced record set again,
+/// after the watch reported (SYNC_RESET) that a delta did not apply.
+/////////////////////////////////////////////////////////////////////////////
+function resyncRecordSet(setKey) {
+  var state = syncStates[setKey];
+  if (!state) {
+    console.log("Nothing to resync for " + setKey);
+    return;
+  }
+
+  var records = [];
+  var keys = [];
+  for (var id in state.byKey) {
+    if (state.byKey.hasOwnProperty(id)) {
+      records.push(state.byKey[id].record);
+      keys.push(state.byKey[id].key);
+    }
+  }
+  delete syncStates[setKey];
+
+  var dictionary = {};
+  dictionary[setKey] = new RecordSet(records, keys, state.scope);
+  sendDictionary(dictionary);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Records that a delta-synced record set was sent in coded form (such as
+/// LENDER_COUNTRY_MAP) instead. The watch holds no generation of it then,
+/// so the next send is a full set; the records are kept for SYNC_RESET.
+/////////////////////////////////////////////////////////////////////////////
+function mapRecordSet(setKey, recordSet) {
+  var byKey = {};
+  for (var ridx = 0; ridx < recordSet.records.length; ridx++) {
+    byKey[String(recordSet.keys[ridx])] = { record: recordSet.records[ridx], key: recordSet.keys[ridx] };
+  }
+  syncStates[setKey] = { gen: 0, scope: recordSet.scope, byKey: byKey, deltaQty: 0, mapped: true };
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Splits a dictionary into the messages that carry it. Plain values go in
+/// the first message, except for chunkHeaderKeys, which go in every one. A
+/// RecordSet value is split into chunks of whole records so that no message
+/// exceeds maxChunkBytes, each tagged with TRANSFER_ID, CHUNK_SEQ and
+/// CHUNK_QTY, so that the watch can ingest every chunk as it arrives and ask
+/// for any that go missing.
+/// @param[in]      dictionary  Key/value pairs to send; at most one value
+///       may be a RecordSet
+/// @return  Array of dictionaries, in sending order
+/////////////////////////////////////////////////////////////////////////////
+function chunkDictionary(dictionary) {
+  var plain = {};
+  var setKey = null;
+  for (var key in dictionary) {
+    if (dictionary.hasOwnProperty(key)) {
+      if (dictionary[key] instanceof RecordSet) setKey = key;
+      else plain[key] = dictionary[key];
+    }
+  }
+  if (setKey === null) return [plain];
+
+  // A watch that cannot reassemble chunks gets as much of the set as fits
+  // in one message.
+  if (!usesCap(CAP_CHUNKED)) {
+    plain[setKey] = joinRecords(fitRecordSet(dictionary[setKey], maxChunkBytes - dictSize(plain) - 7).records);
+    return [plain];
+  }
+
+  // Every chunk carries the set tuple, the chunk header and the header keys;
+  // the first one carries the other plain values as well.
+  var header = {};
+  for (var kidx = 0; kidx < chunkHeaderKeys.length; kidx++) {
+    if (chunkHeaderKeys[kidx] in plain) header[chunkHeaderKeys[kidx]] = plain[chunkHeaderKeys[kidx]];
+  }
+  var chunkOverhead = 7 + 3 * (7 + 4);
+  var firstBudget = maxChunkBytes - dictSize(plain) - chunkOverhead;
+  var restBudget = maxChunkBytes - dictSize(header) - chunkOverhead;
+
+  // Group whole records into chunks.
+  var records = dictionary[setKey].records;
+  var groups = [[]];
+  var groupBytes = 0;
+  for (var ridx = 0; ridx < records.length; ridx++) {
+    var size = recordSize(records[ridx]);
+    var budget = (groups.length === 1) ? firstBudget : restBudget;
+    if (groupBytes > 0 && groupBytes + size > budget) {
+      groups.push([]);
+      groupBytes = 0;
+    }
+    groups[groups.length - 1].push(records[ridx]);
+    groupBytes += size;
+  }
+
+  var transferId = nextTransferId++;
+  var chunks = [];
+  for (var seq = 0; seq < groups.length; seq++) {
+    var chunk = (seq === 0) ? plain : {};
+    for (var hidx = 0; hidx < chunkHeaderKeys.length; hidx++) {
+      if (chunkHeaderKeys[hidx] in plain) chunk[chunkHeaderKeys[hidx]] = plain[chunkHeaderKeys[hidx]];
+    }
+    chunk[setKey] = joinRecords(groups[seq]);
+    chunk.TRANSFER_ID = transferId;
+    chunk.CHUNK_SEQ = seq;
+    chunk.CHUNK_QTY = groups.length;
+    chunks.push(chunk);
+  }
+
+  // Older transfers of this record set have been superseded on the watch.
+  for (var oldId in sentTransfers) {
+    if (sentTransfers.hasOwnProperty(oldId) && sentTransfers[oldId].key === setKey) delete sentTransfers[oldId];
+  }
+  sentTransfers[transferId] = { key: setKey, chunks: chunks, dictionary: dictionary };
+  return chunks;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Sends messages to the watch one at a time, each after the previous one
+/// has been acknowledged. A message that fails is skipped; the watch asks
+/// for missing chunks by itself.
+/// @param[in]      messages  Dictionaries to send, in order
+/// @param[in]      onAcked  Called once if every message was acknowledged;
+///       may be undefined
+/////////////////////////////////////////////////////////////////////////////
+function sendMessages(messages, onAcked) {
+  if (messages.length === 0) {
+    if (onAcked) onAcked();
+    return;
+  }
+
+  Pebble.sendAppMessage(messages[0],
+    function(e) {
+      sendMessages(messages.slice(1), onAcked);
+    },
+    function(e) {
+      console.log("Error sending data to Pebble!");
+      sendMessages(messages.slice(1));
+    }
+  );
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Sends a dictionary to the watch, splitting it into chunks as needed.
+/// @param[in]      dictionary  Key/value pairs to send
+/// @param[in]      requestId  REQUEST_ID of the watch request being
+///       answered, echoed in every chunk; undefined if unsolicited
+/////////////////////////////////////////////////////////////////////////////
+function sendDictionary(dictionary, requestId) {
+  if (requestId) dictionary.REQUEST_ID = requestId;
+  var defines = [];
+  for (var key in dictionary) {
+    if (dictionary.hasOwnProperty(key) && dictionary[key] instanceof RecordSet) {
+      if (dictionary[key].defines) defines = dictionary[key].defines;
+      if (usesCap(CAP_DELTA_SYNC)) syncRecordSet(dictionary, key);
+    }
+  }
+  var messages = chunkDictionary(dictionary);
+  console.log("Sending " + messages.length + " message(s) to Pebble.");
+  // Countries may be named by index once the watch has their records.
+  sendMessages(messages, function() {
+    for (var didx = 0; didx < defines.length; didx++) countryDict.defined[defines[didx]] = true;
+  });
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Sends the requested chunks of a transfer again.
+/// @param[in]      request  "<transfer ID>|<seq>|<seq>..." as sent by the
+///       watch
+/////////////////////////////////////////////////////////////////////////////
+function resendChunks(request) {
+  var parts = String(request).split("|");
+  var transfer = sentTransfers[parts[0]];
+  if (!transfer) {
+    console.log("Cannot resend chunks of unknown transfer " + parts[0]);
+    return;
+  }
+
+  var messages = [];
+  var oversized = false;
+  for (var pidx = 1; pidx < parts.length; pidx++) {
+    var chunk = transfer.chunks[parseInt(parts[pidx], 10)];
+    if (chunk) {
+      messages.push(chunk);
+      if (dictSize(chunk) > maxChunkBytes) oversized = true;
+    }
+  }
+  if (oversized) {
+    // The watch has asked for smaller chunks since, so the whole transfer
+    // is split again and sent under a new transfer ID.
+    console.log("Resending transfer " + parts[0] + " in chunks of at most " + maxChunkBytes + " bytes");
+    sendMessages(chunkDictionary(transfer.dictionary));
+    return;
+  }
+  console.log("Resending " + messages.length + " chunk(s) of transfer " + parts[0]);
+  sendMessages(messages);
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 var xhrRequest = function (method, url, callback) {
@@ -70,8 +713,18 @@ var xhrRequest = function (method, url, callback) {
 ///       we need to fetch from the webservice. If maxResults is zero, then
 ///       all results will be fetched. (If zero results is really desired,
 ///       then don't call this function!)
+/// @param[in]      requestId  REQUEST_ID of the watch request that asked
+///       for the data; echoed back so the watch can match the response
+/// @param[in]      condition  { part, tag } for an answer that is tagged
+///       with a DATA_TAG: if its content still hashes to tag, which the
+///       watch holds, NOT_MODIFIED is sent instead; undefined if untagged
+/// @param[in,out]  pageArray  Pages received so far, with keys equal to the
+///       page number (range = [1 .. n pages]); shared by the requests for
+///       the other pages of the same call, so that calls made in parallel
+///       keep their pages apart. Omit on the first call.
 /////////////////////////////////////////////////////////////////////////////
-function callKivaApiAsync(url, parseFxn, maxResults) {
+function callKivaApiAsync(url, parseFxn, maxResults, requestId, condition, pageArray) {
+  pageArray = pageArray || [];
   // Send request
   xhrRequest('GET', url, function(responseText) {
       var json = JSON.parse(responseText);
@@ -106,7 +759,7 @@ function callKivaApiAsync(url, parseFxn, maxResults) {
               allReceived = false;
               // If we have already requested paging in our URL, then don't make more requests.
               if (!url.match(/\&page=/)) {
-                callKivaApiAsync(url + "&page=" + pageIter, parseFxn, maxResults);
+                callKivaApiAsync(url + "&page=" + pageIter, parseFxn, maxResults, requestId, condition, pageArray);
               }
             }
           }
@@ -114,24 +767,22 @@ function callKivaApiAsync(url, parseFxn, maxResults) {
           if (!allReceived) return;
         } // end else
 
-        // Parse results, send to Pebble, and reset the pageArray variable.
+        // Parse results and send to Pebble.
         console.log("Ready to parse JSON array of size " + Object.keys(jsonPageArray).length);
         dictionary = parseFxn(jsonPageArray);
         // Print all key pairs
         for (var key in dictionary) { if (dictionary.hasOwnProperty(key)) console.log(key + " -> " + dictionary[key]); }
 
-        // JRB TODO: Need to check max message size and (if message exceeds
-        // size), send dictionary in chunks
-        Pebble.sendAppMessage(dictionary,
-          function(e) {
-            console.log("Data sent to Pebble successfully!");
-          },
-          function(e) {
-            console.log("Error sending data to Pebble!");
+        if (condition && usesCap(CAP_NOT_MODIFIED)) {
+          var tag = dataTag(condition.part, dictionary);
+          if (tag === condition.tag) {
+            console.log("Data tag " + tag.toString(16) + " is unchanged.");
+            sendMessages([{ "NOT_MODIFIED": tag, "REQUEST_ID": requestId }]);
+            return;
           }
-        );
-        console.log("Clearing page array...");
-        pageArray = [];
+          dictionary.DATA_TAG = tag;
+        }
+        sendDictionary(dictionary, requestId);
       }
     } // end embedded function
   ); // end xhrRequest
@@ -140,7 +791,7 @@ function callKivaApiAsync(url, parseFxn, maxResults) {
 
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
-function getLenderInfo(lenderId) {
+function getLenderInfo(lenderId, requestId, knownTag) {
   if (!lenderId) {
     Pebble.showSimpleNotificationOnPebble(appName, "Enter a Kiva Lender ID in Settings on your phone.");
     return;
@@ -171,13 +822,13 @@ function getLenderInfo(lenderId) {
     return dictionary;
   };
 
-  callKivaApiAsync(url, parseFxn, maxResults);
+  callKivaApiAsync(url, parseFxn, maxResults, requestId, { part: PART_LENDER_PROFILE, tag: knownTag });
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
-function getLoansForLender(lenderId) {
+function getLoansForLender(lenderId, requestId, knownTag) {
   if (!lenderId) {
     Pebble.showSimpleNotificationOnPebble(appName, "Enter a Kiva Lender ID in Settings on your phone.");
     return;
@@ -227,31 +878,31 @@ function getLoansForLender(lenderId) {
       }
     } // end page iteration
 
-    // Assemble Lender's Kiva countries
-    var lenderCCFlat = "";
-    for (var key in lenderCC) {
-      if (lenderCC.hasOwnProperty(key)) {
-        lenderCCFlat = lenderCCFlat + key + "|" + lenderCC[key] + "|";
-      }
-    }
-    lenderCCFlat = lenderCCFlat.substring(0, lenderCCFlat.length - 1);
-
-    // Assemble dictionary using our keys
+    // Assemble dictionary using our keys. Once the watch has the records of
+    // all of the lender's countries, a bitmap of their indices will do.
+    var coverage = countryCoverage(Object.keys(lenderCC));
+    var recordSet = encodeCountrySet(lenderCC, lenderId);
     dictionary = {
-      "LENDER_LOAN_QTY"    : lenderLoanQty,
-      "LENDER_COUNTRY_SET" : lenderCCFlat
+      "LENDER_LOAN_QTY"    : lenderLoanQty
     };
+    if (usesCap(CAP_COUNTRY_DICT)) dictionary.DICT_ID = countryDict.id;
+    if (coverage) {
+      dictionary.LENDER_COUNTRY_MAP = coverage;
+      mapRecordSet("LENDER_COUNTRY_SET", recordSet);
+    } else {
+      dictionary.LENDER_COUNTRY_SET = recordSet;
+    }
 
     return dictionary;
   }; // end parseFxn
 
-  callKivaApiAsync(url, parseFxn, maxResults);
+  callKivaApiAsync(url, parseFxn, maxResults, requestId, { part: PART_LENDER_LOANS, tag: knownTag });
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
-function getKivaActiveFieldPartners() {
+function getKivaActiveFieldPartners(requestId) {
   var url = baseKivaUrl + "partners" + jsonExt + "?" + kivaAppIdParam;
   var maxResults = 0;
 
@@ -304,30 +955,23 @@ function getKivaActiveFieldPartners() {
     } // end page iteration
 
 
-    // Assemble Kiva countries not previously sent to watch
-    var deltaKivaCCFlat = "";
-    for (var key in deltaKivaCC) {
-      if (deltaKivaCC.hasOwnProperty(key)) {
-        deltaKivaCCFlat = deltaKivaCCFlat + key + "|" + deltaKivaCC[key] + "|";
-      }
-    }
-    deltaKivaCCFlat = deltaKivaCCFlat.substring(0, deltaKivaCCFlat.length - 1);
-
-    // Assemble dictionary using our keys
+    // Assemble dictionary using our keys; only Kiva countries not
+    // previously sent to watch.
     dictionary = {
-      "KIVA_COUNTRY_SET" : deltaKivaCCFlat
+      "KIVA_COUNTRY_SET" : encodeCountrySet(deltaKivaCC)
     };
+    if (usesCap(CAP_COUNTRY_DICT)) dictionary.DICT_ID = countryDict.id;
 
     return dictionary;
   }; // end parseFxn
 
-  callKivaApiAsync(url, parseFxn, maxResults);
+  callKivaApiAsync(url, parseFxn, maxResults, requestId);
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
-function getPreferredLoans(prefCC, maxResults) {
+function getPreferredLoans(prefCC, maxResults, requestId, knownTag) {
   var url = baseKivaUrl + "loans/search" + jsonExt + "?" + kivaAppIdParam + "&status=fundraising&country_code=" + prefCC;
   console.log("URL: " + url);
 
@@ -336,8 +980,8 @@ function getPreferredLoans(prefCC, maxResults) {
     var json = "";
     // pageNum range = [1 .. n pages];   pageIter range = [0 .. n-1 pages]
     var pageNum, pageSize, pageTotal, pageIter;
-    var loansFlat = "";
-    var loanQty, loanId, name, use, countryCode, fundedAmt, loanAmt;
+    var loans = [];
+    var loanQty;
 
     for (pageIter=0; pageIter < Object.keys(jsonPageArray).length; pageIter++) {
       json = JSON.parse(jsonPageArray[pageIter]);
@@ -362,76 +1006,112 @@ function getPreferredLoans(prefCC, maxResults) {
 
       // Iterate through each loan.
       for (var lidx = 0; lidx < idxLimit && (pageSize * pageIter + lidx) < loanQty; lidx++) {
-        loanId = json.loans[lidx].id;
-        name = json.loans[lidx].name;
-        use = json.loans[lidx].use;
-        countryCode = json.loans[lidx].location.country_code;
-        fundedAmt = json.loans[lidx].funded_amount;
-        loanAmt = json.loans[lidx].loan_amount;
-
-        loansFlat = loansFlat +
-            loanId +      "|" +
-            name +        "|" +
-            use +         "|" +
-            countryCode + "|" +
-            fundedAmt +   "|" +
-            loanAmt +     "|";
+        loans.push(json.loans[lidx]);
       }
 
     } // end page iteration
 
 
-    loansFlat = loansFlat.substring(0, loansFlat.length - 1);
-
     // Assemble dictionary using our keys
     dictionary = {
-      "LOAN_SET" : loansFlat
+      "LOAN_SET" : encodeLoanSet(loans)
     };
 
     return dictionary;
   }; // end parseFxn
 
-  callKivaApiAsync(url, parseFxn, maxResults);
+  callKivaApiAsync(url, parseFxn, maxResults, requestId, { part: PART_LOAN_SET, tag: knownTag });
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
-/// Listen for when an AppMessage is received.
+/// Handlers for the requests the watch sends, in the order they are run
+/// when the watch batches several requests into one AppMessage. Each is
+/// also handed the REQUEST_ID of the AppMessage, for its responses to echo.
+/////////////////////////////////////////////////////////////////////////////
+var appMessageHandlers = {
+  PROTOCOL_CAPS: function(value) {
+    var parts = String(value).split(":");
+    var version = parseInt(parts[0], 10) || 1;
+    watchCaps = (version >= 2) ? (parseInt(parts[1], 10) || 0) : 0;
+    console.log("Watch speaks protocol " + version + " with capabilities " + watchCaps + "; using " + (localCaps & watchCaps) + ".");
+  },
+  INBOX_SIZE: function(size) {
+    size = parseInt(size, 10);
+    if (size > 0) maxChunkBytes = size;
+    console.log("Watch inbox holds " + maxChunkBytes + " bytes.");
+  },
+  CHUNK_SIZE: function(size) {
+    size = parseInt(size, 10);
+    if (size > 0 && size < maxChunkBytes) maxChunkBytes = size;
+    console.log("Watch asked for chunks of at most " + maxChunkBytes + " bytes.");
+  },
+  GET_KIVA_INFO: function(value, requestId) {
+    getKivaActiveFieldPartners(requestId);
+  },
+  GET_LENDER_INFO: function(request, requestId) {
+    var lenderId = splitDataTags(request).payload;
+    var tags = splitDataTags(request).tags;
+    console.log("Got lender ID (" + lenderId + ")... now getting lender info...");
+    getLenderInfo(lenderId, requestId, tags[PART_LENDER_PROFILE]);
+    console.log("Got lender info... now getting lender's loans...");
+    getLoansForLender(lenderId, requestId, tags[PART_LENDER_LOANS]);
+  },
+  GET_PREFERRED_LOANS: function(request, requestId) {
+    var maxResults = 5;
+    var tags = splitDataTags(request).tags;
+    var prefCC = decodeCountryList(splitDataTags(request).payload);
+    if (prefCC === null) {
+      // Coded by a previous session; the watch asks again once it has
+      // this session's countries.
+      console.log("Ignoring loan request coded against another country dictionary.");
+      return;
+    }
+    getPreferredLoans(prefCC, maxResults, requestId, tags[PART_LOAN_SET]);
+  },
+  CHUNK_RESEND: function(request) {
+    resendChunks(request);
+  },
+  SYNC_RESET: function(setKey) {
+    resyncRecordSet(setKey);
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// Listen for when an AppMessage is received. Every request in the
+/// dictionary is handled.
 /////////////////////////////////////////////////////////////////////////////
 Pebble.addEventListener('appmessage',
   function(e) {
     console.log("AppMessage received: " + JSON.stringify(e.payload));
     var dict = e.payload;
+    var handled = 0;
 
-    if ('GET_KIVA_INFO' in dict) {
-      getKivaActiveFieldPartners();
-    } else if ('GET_LENDER_INFO' in dict) {
-      var lenderId = dict.GET_LENDER_INFO;
-      console.log("Got lender ID (" + lenderId + ")... now getting lender info...");
-      getLenderInfo(lenderId);
-      console.log("Got lender info... now getting lender's loans...");
-      getLoansForLender(lenderId);
-    } else if ('GET_PREFERRED_LOANS' in dict) {
-      var prefCC = dict.GET_PREFERRED_LOANS;
-      var maxResults = 5;
-      getPreferredLoans(prefCC, maxResults);
-    } else {
-      console.log("Unrecognized app message: " + JSON.stringify(dict));
+    for (var key in appMessageHandlers) {
+      if (key in dict) {
+        appMessageHandlers[key](dict[key], dict.REQUEST_ID);
+        handled++;
+      }
     }
 
-
+    if (handled === 0) {
+      console.log("Unrecognized app message: " + JSON.stringify(dict));
+    }
   }
 );
 
 
 /////////////////////////////////////////////////////////////////////////////
 /// Listen for when the watch opens communication and inform the watch that
-/// the PebbleKit end of the channel is ready.
+/// the PebbleKit end of the channel is ready, along with the protocol
+/// version and capabilities of this script. The watch answers with its
+/// own PROTOCOL_CAPS ahead of its first requests.
 /////////////////////////////////////////////////////////////////////////////
 Pebble.addEventListener('ready',
   function(e) {
     console.log("PebbleKit JS ready!");
-    Pebble.sendAppMessage({"PEBKIT_READY": 1});
+    Pebble.sendAppMessage({"PEBKIT_READY": protocolVersion, "PROTOCOL_CAPS": localCaps});
   }
 );
 